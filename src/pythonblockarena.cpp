@@ -0,0 +1,80 @@
+#include "pythonblockarena.h"
+
+#include <new>
+
+namespace PyEditor {
+namespace Internal {
+
+BlockArena::BlockArena()
+{
+    std::memset(m_freeLists, 0, sizeof(m_freeLists));
+}
+
+BlockArena::~BlockArena()
+{
+    for (char *chunk : m_chunks)
+        ::operator delete(chunk);
+}
+
+void *BlockArena::allocate(size_t size)
+{
+    const size_t rounded = roundUp(qMax(size, sizeof(void *)));
+    ++m_live;
+    m_used += rounded;
+
+    if (rounded > size_t(SizeClasses * Granularity)) {
+        m_reserved += rounded;
+        return ::operator new(rounded);
+    }
+
+    void *&freeList = m_freeLists[rounded / Granularity - 1];
+    if (freeList) {
+        void *p = freeList;
+        freeList = *static_cast<void **>(p);
+        return p;
+    }
+
+    if (m_left < rounded) {
+        m_current = static_cast<char *>(::operator new(ChunkSize));
+        m_left = ChunkSize;
+        m_chunks.append(m_current);
+        m_reserved += ChunkSize;
+    }
+
+    void *p = m_current;
+    m_current += rounded;
+    m_left -= rounded;
+    return p;
+}
+
+void BlockArena::deallocate(void *p, size_t size)
+{
+    const size_t rounded = roundUp(qMax(size, sizeof(void *)));
+    --m_live;
+    m_used -= rounded;
+
+    if (rounded > size_t(SizeClasses * Granularity)) {
+        m_reserved -= rounded;
+        ::operator delete(p);
+    } else {
+        void *&freeList = m_freeLists[rounded / Granularity - 1];
+        *static_cast<void **>(p) = freeList;
+        freeList = p;
+    }
+
+    if (m_released && m_live == 0)
+        delete this;
+}
+
+/**
+ * @brief Owner gives arena up, it's deleted with the last allocation
+ */
+void BlockArena::release()
+{
+    m_released = true;
+    if (m_live == 0)
+        delete this;
+}
+
+} // namespace Internal
+} // namespace PythonEditor
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QVector>
+
+#include <cstring>
+
+namespace PyEditor {
+namespace Internal {
+
+/**
+ * @brief The BlockArena class - per-document allocator of highlighter block data
+ *
+ * Memory is cut from large chunks, which are released together when arena
+ * is destroyed. Freed pieces go to free lists by size class and are reused,
+ * so rehighlighting and deleting blocks don't touch the heap.
+ *
+ * QTextDocument deletes block user data after the highlighter (its child) is
+ * destroyed, so the owner doesn't delete arena, but calls release(): arena
+ * deletes itself when the last allocation is freed. Not thread-safe, block
+ * data lives in GUI thread only.
+ */
+class BlockArena
+{
+    BlockArena(const BlockArena &other) = delete;
+    void operator=(const BlockArena &other) = delete;
+
+public:
+    enum {
+        Granularity = 16,
+        SizeClasses = 32,   // pieces up to 512 bytes come from chunks
+        ChunkSize = 64 * 1024
+    };
+
+    BlockArena();
+
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+    void release();
+
+    qint64 bytesUsed() const { return m_used; }
+    qint64 bytesReserved() const { return m_reserved; }
+
+private:
+    ~BlockArena();
+
+    static size_t roundUp(size_t size)
+    { return (size + Granularity - 1) & ~size_t(Granularity - 1); }
+
+    QVector<char *> m_chunks;
+    char *m_current = 0;
+    size_t m_left = 0;
+    void *m_freeLists[SizeClasses];
+
+    qint64 m_live = 0;
+    qint64 m_used = 0;
+    qint64 m_reserved = 0;
+    bool m_released = false;
+};
+
+/**
+ * @brief Growable array of trivially copyable items in BlockArena
+ */
+template <typename T>
+class ArenaVector
+{
+    ArenaVector(const ArenaVector &other) = delete;
+    void operator=(const ArenaVector &other) = delete;
+
+public:
+    explicit ArenaVector(BlockArena *arena) : m_arena(arena) {}
+
+    ~ArenaVector()
+    {
+        if (m_data)
+            m_arena->deallocate(m_data, m_capacity * sizeof(T));
+    }
+
+    void append(const T &value)
+    {
+        if (m_size == m_capacity)
+            grow();
+        m_data[m_size++] = value;
+    }
+
+    void clear() { m_size = 0; }
+    int size() const { return m_size; }
+    T *begin() { return m_data; }
+    T *end() { return m_data + m_size; }
+    const T *begin() const { return m_data; }
+    const T *end() const { return m_data + m_size; }
+
+private:
+    void grow()
+    {
+        const int capacity = m_capacity ? m_capacity * 2 : 4;
+        T *data = static_cast<T *>(m_arena->allocate(capacity * sizeof(T)));
+        if (m_size)
+            std::memcpy(data, m_data, m_size * sizeof(T));
+        if (m_data)
+            m_arena->deallocate(m_data, m_capacity * sizeof(T));
+        m_data = data;
+        m_capacity = capacity;
+    }
+
+    BlockArena *m_arena;
+    T *m_data = 0;
+    int m_size = 0;
+    int m_capacity = 0;
+};
+
+} // namespace Internal
+} // namespace PythonEditor
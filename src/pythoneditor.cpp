@@ -1,11 +1,736 @@
 #include "pythoneditor.h"
 #include "pythonhighlighter.h"
+#include "pythonlanguageprofile.h"
+#include "pythonlatencyrecorder.h"
+#include "pythonscanner.h"
+
+#include <QAbstractTextDocumentLayout>
+#include <QApplication>
+#include <QClipboard>
+#include <QMimeData>
+#include <QPainter>
+#include <QScopedPointer>
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QTextLayout>
+
+#include <algorithm>
+
+Q_STATIC_ASSERT(sizeof(PythonToken) == 4 * sizeof(qint32));
+
+using namespace PyEditor::Internal;
+
+// marks extra selections made by occurrence marking, others belong to the user
+static const int OccurrenceProperty = QTextFormat::UserProperty + 0x5059;
+
+// glyph caches kept at least, and per painted block
+static const int MinCachedBlocks = 128;
+static const int CachedBlocksPerPainted = 3;
+
+static int appendTokens(QVector<PythonToken> &tokens, const QChar *text, int length, int offset, int state,
+                        const IdentifierTable *identifiers)
+{
+    Tokenizer tokenizer(text, length, state, identifiers);
+
+    FormatToken tk;
+    while (!(tk = tokenizer.read()).isEndOfBlock()) {
+        const PythonToken token = { offset + tk.begin(), tk.length(), tk.format(), tokenizer.state() };
+        tokens.append(token);
+    }
+
+    return tokenizer.state();
+}
 
 PythonEditor::PythonEditor(QWidget *parent)
     : QPlainTextEdit(parent)
 {
     m_highlighter = new PyEditor::Internal::PythonHighlighter(document());
+    m_latency = new PyEditor::Internal::LatencyRecorder;
+    m_glyphCaches = new PyEditor::Internal::GlyphCacheList;
+    m_highlighter->setLatencyRecorder(m_latency);
+
+    connect(this, &QPlainTextEdit::cursorPositionChanged, this, &PythonEditor::updateOccurrences);
+    connect(this, &QPlainTextEdit::cursorPositionChanged, this, &PythonEditor::recordCursorMove);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &PythonEditor::updateOccurrences);
+}
+
+PythonEditor::~PythonEditor()
+{
+    m_highlighter->setLatencyRecorder(0);
+    delete m_latency;
+    delete m_glyphCaches;
 }
 
 void PythonEditor::setFormatStyle(PythonEditor::Format fmt, const QColor &color, PythonEditor::FontStyle style)
-{ m_highlighter->setFormatStyle(fmt, color, style); }
+{
+    m_highlighter->setFormatStyle(fmt, color, style);
+    ++m_glyphRevision;
+}
+
+/**
+ * @brief Sets language profile: Python 2, Python 3 (default) or Cython names
+ * with custom additions, rehighlights document
+ */
+void PythonEditor::setLanguageProfile(const PythonLanguageProfile &profile)
+{ m_highlighter->setLanguageProfile(profile); }
+
+PythonLanguageProfile PythonEditor::languageProfile() const
+{ return m_highlighter->languageProfile(); }
+
+/**
+ * @brief Starts bulk edit transaction
+ *
+ * Until the matching endBulkEdit() document changes are not rehighlighted,
+ * only the changed range is collected. Use it around replace-all, reindent
+ * or scripted edits which touch the same blocks many times. Calls may be nested.
+ */
+void PythonEditor::beginBulkEdit()
+{ m_highlighter->beginBulkEdit(); }
+
+/**
+ * @brief Finishes bulk edit transaction with one highlight pass and one viewport update
+ */
+void PythonEditor::endBulkEdit()
+{
+    if (m_highlighter->bulkEditDepth() != 1) {
+        m_highlighter->endBulkEdit();
+        return;
+    }
+
+    const bool updatesEnabled = viewport()->updatesEnabled();
+    viewport()->setUpdatesEnabled(false);
+    m_highlighter->endBulkEdit();
+    viewport()->setUpdatesEnabled(updatesEnabled);
+}
+
+/**
+ * @brief Returns token stream of blocks firstBlock..lastBlock (inclusive)
+ *
+ * Offsets are document positions. The scanner starts with state saved
+ * by highlighter for the block preceding firstBlock and uses its language profile.
+ */
+QVector<PythonToken> PythonEditor::tokens(int firstBlock, int lastBlock) const
+{
+    QVector<PythonToken> result;
+    const PythonLanguageProfile profile = m_highlighter->languageProfile();
+
+    QTextBlock block = document()->findBlockByNumber(qMax(0, firstBlock));
+    int state = qMax(0, block.previous().userState());
+    for (int number = qMax(0, firstBlock); block.isValid() && number <= lastBlock; ++number) {
+        const QString text = block.text();
+        state = appendTokens(result, text.constData(), text.size(), block.position(), state,
+                             profile.identifierTable());
+        block = block.next();
+    }
+
+    return result;
+}
+
+/**
+ * @brief Returns token stream of arbitrary source, offsets are positions in source
+ *
+ * This is the re-entrant scanning entry point: it doesn't touch any editor or
+ * highlighter and shares only immutable identifier tables, so it may be called
+ * concurrently from any number of threads. Python bindings release the GIL
+ * while scanning, so batch jobs scale with worker threads. Identifiers are
+ * classified with profile, or with Python 3 names if profile is null. Scanning
+ * uses a copy of profile, which keeps its compiled table alive even if names
+ * are added to the original meanwhile.
+ */
+QVector<PythonToken> PythonEditor::tokenize(const QString &source, int initialState,
+                                            const PythonLanguageProfile *profile)
+{
+    QVector<PythonToken> result;
+    QScopedPointer<const PythonLanguageProfile> profileCopy(profile ? new PythonLanguageProfile(*profile) : 0);
+    const IdentifierTable *identifiers = profileCopy ? profileCopy->identifierTable() : 0;
+
+    const int size = source.size();
+    int state = initialState;
+    int lineStart = 0;
+    while (lineStart <= size) {
+        int lineEnd = source.indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd < 0)
+            lineEnd = size;
+        state = appendTokens(result, source.constData() + lineStart, lineEnd - lineStart, lineStart, state,
+                             identifiers);
+        lineStart = lineEnd + 1;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Enables or disables highlighting of identifier under cursor in the visible area
+ */
+void PythonEditor::setMarkOccurrences(bool enabled)
+{
+    m_markOccurrences = enabled;
+    updateOccurrences();
+}
+
+bool PythonEditor::markOccurrences() const
+{ return m_markOccurrences; }
+
+void PythonEditor::setOccurrencesBackground(const QColor &color)
+{
+    m_occurrencesBackground = color;
+    updateOccurrences();
+}
+
+/**
+ * @brief Marks occurrences of identifier under cursor
+ *
+ * Highlighter keeps interned identifiers of every block up to date, so there is
+ * no rescan here: only visible blocks are checked, comparing integer ids.
+ * Extra selections set through QPlainTextEdit API are kept, occurrences are
+ * added after them.
+ */
+void PythonEditor::updateOccurrences()
+{
+    if (!m_markOccurrences && !m_hasOccurrenceSelections)
+        return;
+
+    QList<QTextEdit::ExtraSelection> selections;
+    for (const QTextEdit::ExtraSelection &selection : extraSelections()) {
+        if (!selection.format.hasProperty(OccurrenceProperty))
+            selections.append(selection);
+    }
+    const int userSelections = selections.size();
+
+    const QTextCursor cursor = textCursor();
+    const int id = m_markOccurrences && !cursor.hasSelection()
+            ? PythonHighlighter::identifierAt(cursor.block(), cursor.positionInBlock())
+            : -1;
+
+    if (id >= 0) {
+        QTextCharFormat format;
+        format.setBackground(m_occurrencesBackground);
+        format.setProperty(OccurrenceProperty, true);
+
+        const QPointF offset = contentOffset();
+        const int bottom = viewport()->rect().bottom();
+        for (QTextBlock block = firstVisibleBlock(); block.isValid(); block = block.next()) {
+            if (!block.isVisible())
+                continue;
+            if (blockBoundingGeometry(block).translated(offset).top() > bottom)
+                break;
+
+            const PythonBlockData *data = static_cast<const PythonBlockData *>(block.userData());
+            if (!data)
+                continue;
+
+            for (const IdentifierOccurrence &occurrence : data->identifiers) {
+                if (occurrence.id != id)
+                    continue;
+
+                QTextEdit::ExtraSelection selection;
+                selection.cursor = QTextCursor(document());
+                selection.cursor.setPosition(block.position() + occurrence.position);
+                selection.cursor.setPosition(block.position() + occurrence.position + occurrence.length,
+                                             QTextCursor::KeepAnchor);
+                selection.format = format;
+                selections.append(selection);
+            }
+        }
+    }
+
+    const bool hasOccurrenceSelections = selections.size() > userSelections;
+    if (!hasOccurrenceSelections && !m_hasOccurrenceSelections)
+        return;
+
+    m_hasOccurrenceSelections = hasOccurrenceSelections;
+    setExtraSelections(selections);
+}
+
+/**
+ * @brief Sets project symbol index used by findSymbols(), editor doesn't own it
+ */
+void PythonEditor::setSymbolIndex(PythonSymbolIndex *index)
+{ m_symbolIndex = index; }
+
+PythonSymbolIndex *PythonEditor::symbolIndex() const
+{ return m_symbolIndex; }
+
+/**
+ * @brief Looks up "go to symbol" candidates in project symbol index
+ */
+QList<PythonSymbol> PythonEditor::findSymbols(const QString &prefix, int limit) const
+{
+    if (!m_symbolIndex)
+        return QList<PythonSymbol>();
+    return m_symbolIndex->find(prefix, limit);
+}
+
+/**
+ * @brief Starts or stops recording of keystroke-to-paint latency
+ *
+ * Starting clears previous statistics. While recording, input events are also
+ * kept as session, see recordedSession().
+ */
+void PythonEditor::setLatencyRecording(bool enabled)
+{ m_latency->setEnabled(enabled, textCursor().position()); }
+
+bool PythonEditor::isLatencyRecording() const
+{ return m_latency->isEnabled(); }
+
+void PythonEditor::resetLatencyRecording()
+{ m_latency->reset(textCursor().position()); }
+
+PythonLatencyReport PythonEditor::latencyReport() const
+{ return m_latency->report(); }
+
+/**
+ * @brief Returns input events recorded since recording started, one per line,
+ * in format of pythoneditor-replay tool
+ */
+QStringList PythonEditor::recordedSession() const
+{ return m_latency->session(); }
+
+/**
+ * Editor state input can change; input changing none of it, like bare
+ * modifier or arrow at document edge, isn't followed by paint
+ */
+struct InputEffect
+{
+    explicit InputEffect(const PythonEditor *editor)
+        : revision(editor->document()->revision())
+        , position(editor->textCursor().position())
+        , anchor(editor->textCursor().anchor())
+        , scrollX(editor->horizontalScrollBar()->value())
+        , scrollY(editor->verticalScrollBar()->value())
+    {}
+
+    bool operator==(const InputEffect &other) const
+    {
+        return revision == other.revision && position == other.position && anchor == other.anchor
+                && scrollX == other.scrollX && scrollY == other.scrollY;
+    }
+
+    int revision;
+    int position;
+    int anchor;
+    int scrollX;
+    int scrollY;
+};
+
+void PythonEditor::keyPressEvent(QKeyEvent *e)
+{
+    if (!m_latency->isEnabled()) {
+        QPlainTextEdit::keyPressEvent(e);
+        return;
+    }
+
+    if (e->matches(QKeySequence::Paste))
+        m_latency->textPasted(QApplication::clipboard()->text());
+    m_latency->keyPressed(e);
+
+    const InputEffect before(this);
+    m_latency->inputStarted(e->timestamp());
+    QPlainTextEdit::keyPressEvent(e);
+    if (e->isAccepted() && !(InputEffect(this) == before))
+        m_latency->inputFinished();
+    else
+        m_latency->inputCancelled();
+}
+
+void PythonEditor::inputMethodEvent(QInputMethodEvent *e)
+{
+    if (!m_latency->isEnabled()) {
+        QPlainTextEdit::inputMethodEvent(e);
+        return;
+    }
+
+    m_latency->inputMethodCommitted(e);
+
+    // preedit only events are not measured
+    const InputEffect before(this);
+    m_latency->inputStarted(0);
+    QPlainTextEdit::inputMethodEvent(e);
+    if (!e->commitString().isEmpty() && !(InputEffect(this) == before))
+        m_latency->inputFinished();
+    else
+        m_latency->inputCancelled();
+}
+
+/**
+ * @brief Records paste or drop not made by recorded key as typed text
+ */
+void PythonEditor::insertFromMimeData(const QMimeData *source)
+{
+    if (m_latency->isEnabled() && !m_latency->isInputPending() && source->hasText())
+        m_latency->textInserted(source->text());
+    QPlainTextEdit::insertFromMimeData(source);
+}
+
+/**
+ * @brief Records cursor move made not by recorded input, e.g. by mouse
+ */
+void PythonEditor::recordCursorMove()
+{
+    if (!m_latency->isEnabled() || m_latency->isInputPending())
+        return;
+
+    const QTextCursor cursor = textCursor();
+    m_latency->cursorMoved(cursor.position(), cursor.anchor());
+}
+
+void PythonEditor::paintEvent(QPaintEvent *e)
+{
+    if (!m_latency->isEnabled()) {
+        paintBlocks(e);
+        return;
+    }
+
+    m_latency->paintStarted();
+    paintBlocks(e);
+    m_latency->paintFinished();
+}
+
+void PythonEditor::changeEvent(QEvent *e)
+{
+    if (e->type() == QEvent::FontChange || e->type() == QEvent::PaletteChange)
+        ++m_glyphRevision;
+    QPlainTextEdit::changeEvent(e);
+}
+
+/**
+ * @brief Enables or disables painting of blocks from cached glyph runs
+ */
+void PythonEditor::setGlyphCaching(bool enabled)
+{
+    m_glyphCaching = enabled;
+    ++m_glyphRevision;
+    if (!enabled)
+        m_glyphCaches->trim(0);
+    viewport()->update();
+}
+
+bool PythonEditor::glyphCaching() const
+{ return m_glyphCaching; }
+
+/**
+ * @brief Returns estimated bytes used by highlighting: per-block data in
+ * document arena, interned identifier names and glyph caches
+ *
+ * Only per-block data lives in the arena and is released at once with the
+ * document. Glyph runs are heap allocated by Qt, so they are kept for blocks
+ * near the viewport only and freed one by one.
+ */
+qint64 PythonEditor::highlighterMemoryUsage() const
+{ return m_highlighter->memoryUsage() + m_glyphCaches->bytes(); }
+
+static bool hasDecoration(const QTextCharFormat &format)
+{
+    return format.background().style() != Qt::NoBrush
+            || format.fontUnderline()
+            || format.fontOverline()
+            || format.fontStrikeOut();
+}
+
+/**
+ * Shapes block once per highlighting: glyph runs of every format range with
+ * its color. Blocks with decorated formats (backgrounds, underlines) are not
+ * cached, they are drawn by QTextLayout.
+ */
+static bool fillGlyphCache(GlyphCache &cache, QTextLayout *layout, const QColor &textColor)
+{
+    cache.runs.clear();
+
+    QVector<QTextLayout::FormatRange> ranges = layout->formats();
+    std::sort(ranges.begin(), ranges.end(),
+              [](const QTextLayout::FormatRange &a, const QTextLayout::FormatRange &b) {
+        return a.start < b.start;
+    });
+
+    auto addRuns = [&](int from, int length, const QColor &color) {
+        if (length <= 0)
+            return;
+        for (const QGlyphRun &glyphs : layout->glyphRuns(from, length)) {
+            const GlyphCache::Run run = { glyphs, color };
+            cache.runs.append(run);
+            cache.bytes += sizeof(GlyphCache::Run)
+                    + glyphs.glyphIndexes().size() * (sizeof(quint32) + sizeof(QPointF));
+        }
+    };
+
+    int position = 0;
+    for (const QTextLayout::FormatRange &range : ranges) {
+        if (hasDecoration(range.format))
+            return false;
+
+        const QBrush foreground = range.format.foreground();
+        addRuns(position, range.start - position, textColor);
+        addRuns(range.start, range.length,
+                foreground.style() == Qt::NoBrush ? textColor : foreground.color());
+        position = qMax(position, range.start + range.length);
+    }
+    addRuns(position, layout->text().length() - position, textColor);
+
+    return true;
+}
+
+/**
+ * Selection only painting background under text, as occurrences and current
+ * line are, can be drawn under cached glyphs
+ */
+static bool isBackgroundOnly(const QTextCharFormat &format)
+{
+    const QMap<int, QVariant> properties = format.properties();
+    for (QMap<int, QVariant>::const_iterator it = properties.constBegin(); it != properties.constEnd(); ++it) {
+        if (it.key() != QTextFormat::BackgroundBrush
+                && it.key() != QTextFormat::FullWidthSelection
+                && it.key() != OccurrenceProperty)
+            return false;
+    }
+    return true;
+}
+
+static void drawSelectionBackground(QPainter *painter, QTextLayout *layout, const QPointF &position,
+                                    const QTextLayout::FormatRange &selection, qreal right)
+{
+    const QBrush brush = selection.format.background();
+    const bool fullWidth = selection.format.boolProperty(QTextFormat::FullWidthSelection);
+    const int end = selection.start + selection.length;
+    for (int i = 0; i < layout->lineCount(); ++i) {
+        const QTextLine line = layout->lineAt(i);
+        const int from = qMax(selection.start, line.textStart());
+        const int to = qMin(end, line.textStart() + line.textLength());
+        if (from > to || (from == to && !fullWidth))
+            continue;
+
+        QRectF rect = line.naturalTextRect().translated(position);
+        if (fullWidth) {
+            rect.setLeft(position.x());
+            rect.setRight(right);
+        } else {
+            rect.setLeft(position.x() + line.cursorToX(from));
+            rect.setRight(position.x() + line.cursorToX(to));
+        }
+        painter->fillRect(rect, brush);
+    }
+}
+
+/**
+ * Draws block text from glyph cache over background-only selections,
+ * reshaping it only if block text, wrapping or editor paint revision changed
+ * since the cache was filled. Returns false if block must be drawn by layout.
+ */
+static bool drawCachedBlock(QPainter *painter, const QTextBlock &block, const QPointF &offset,
+                            int revision, const QColor &textColor, GlyphCacheList *caches,
+                            const QVector<QTextLayout::FormatRange> &selections, qreal right)
+{
+    PythonBlockData *data = static_cast<PythonBlockData *>(block.userData());
+    QTextLayout *layout = block.layout();
+    if (!data || !layout || layout->lineCount() == 0)
+        return false;
+
+    for (const QTextLayout::FormatRange &selection : selections) {
+        if (!isBackgroundOnly(selection.format))
+            return false;
+    }
+
+    GlyphCache &cache = data->glyphCache;
+    const qreal lineWidth = layout->lineAt(0).width();
+    if (cache.revision != revision || cache.blockRevision != block.revision()
+            || cache.lineWidth != lineWidth || cache.lineCount != layout->lineCount()) {
+        cache.clear();
+        cache.layoutOnly = !fillGlyphCache(cache, layout, textColor);
+        cache.blockRevision = block.revision();
+        cache.lineWidth = lineWidth;
+        cache.lineCount = layout->lineCount();
+        cache.revision = revision;
+    }
+
+    if (cache.layoutOnly)
+        return false;
+    caches->touch(&cache);
+
+    const QPointF position = offset + layout->position();
+    for (const QTextLayout::FormatRange &selection : selections)
+        drawSelectionBackground(painter, layout, position, selection, right);
+
+    for (const GlyphCache::Run &run : cache.runs) {
+        painter->setPen(run.color);
+        painter->drawGlyphRun(position, run.glyphs);
+    }
+
+    return true;
+}
+
+/**
+ * Document wide layout settings, which change glyph positions of all blocks
+ */
+static uint layoutKey(const QTextDocument *document)
+{
+    const QTextOption option = document->defaultTextOption();
+    uint key = qHash(document->defaultFont().key());
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    key = key * 31 + qHash(option.tabStopDistance());
+#else
+    key = key * 31 + qHash(option.tabStop());
+#endif
+    for (const QTextOption::Tab &tab : option.tabs())
+        key = key * 31 + qHash(tab.position) + uint(tab.type);
+    key = key * 31 + uint(option.alignment());
+    key = key * 31 + uint(option.flags());
+    key = key * 31 + uint(option.textDirection());
+    key = key * 31 + uint(option.wrapMode());
+    return key;
+}
+
+/**
+ * @brief Paints visible blocks like QPlainTextEdit::paintEvent() does, but
+ * takes the text of blocks from glyph cache
+ *
+ * Scrolling and cursor blinking repaint blocks whose text and highlighting
+ * didn't change, so they are drawn without QTextLayout shaping and without
+ * splitting the text into many small format ranges again. Only blocks with
+ * selections changing text color are drawn by QTextLayout. Caches of blocks
+ * far from the viewport are freed.
+ */
+void PythonEditor::paintBlocks(QPaintEvent *e)
+{
+    if (!m_glyphCaching || (document()->isEmpty() && !placeholderText().isEmpty())) {
+        QPlainTextEdit::paintEvent(e);
+        return;
+    }
+
+    const uint key = layoutKey(document());
+    if (key != m_layoutKey) {
+        m_layoutKey = key;
+        ++m_glyphRevision;
+    }
+    int paintedBlocks = 0;     // visible ones, including those outside of the update rect
+
+    QPainter painter(viewport());
+    QPointF offset(contentOffset());
+    QRect er = e->rect();
+    const QRect viewportRect = viewport()->rect();
+    const bool editable = !isReadOnly();
+    const qreal maximumWidth = document()->documentLayout()->documentSize().width();
+
+    painter.setBrushOrigin(offset);
+
+    // keep right margin clean from full-width selection
+    const int maxX = offset.x() + qMax(qreal(viewportRect.width()), maximumWidth)
+            - document()->documentMargin();
+    er.setRight(qMin(er.right(), maxX));
+    painter.setClipRect(er);
+
+    const QAbstractTextDocumentLayout::PaintContext context = getPaintContext();
+    const QColor textColor = context.palette.text().color();
+
+    QTextBlock block = firstVisibleBlock();
+    while (block.isValid()) {
+        const QRectF r = blockBoundingRect(block).translated(offset);
+        QTextLayout *layout = block.layout();
+
+        if (!block.isVisible()) {
+            offset.ry() += r.height();
+            block = block.next();
+            continue;
+        }
+
+        if (r.bottom() >= er.top() && r.top() <= er.bottom()) {
+            const QBrush bg = block.blockFormat().background();
+            if (bg != Qt::NoBrush) {
+                QRectF contentsRect = r;
+                contentsRect.setWidth(qMax(r.width(), maximumWidth));
+                painter.fillRect(contentsRect, bg);
+            }
+
+            const int blpos = block.position();
+            const int bllen = block.length();
+
+            QVector<QTextLayout::FormatRange> selections;
+            for (const QAbstractTextDocumentLayout::Selection &range : context.selections) {
+                const int selStart = range.cursor.selectionStart() - blpos;
+                const int selEnd = range.cursor.selectionEnd() - blpos;
+                if (selStart < bllen && selEnd > 0 && selEnd > selStart) {
+                    QTextLayout::FormatRange o;
+                    o.start = selStart;
+                    o.length = selEnd - selStart;
+                    o.format = range.format;
+                    selections.append(o);
+                } else if (!range.cursor.hasSelection()
+                           && range.format.hasProperty(QTextFormat::FullWidthSelection)
+                           && block.contains(range.cursor.position())) {
+                    // full width selection needs a position only to specify the line
+                    QTextLayout::FormatRange o;
+                    const QTextLine line = layout->lineForTextPosition(range.cursor.position() - blpos);
+                    o.start = line.textStart();
+                    o.length = line.textLength();
+                    if (o.start + o.length == bllen - 1)
+                        ++o.length; // include newline
+                    o.format = range.format;
+                    selections.append(o);
+                }
+            }
+
+            const bool drawCursor = (editable || (textInteractionFlags() & Qt::TextSelectableByKeyboard))
+                    && context.cursorPosition >= blpos
+                    && context.cursorPosition < blpos + bllen;
+
+            bool drawCursorAsBlock = drawCursor && overwriteMode();
+            if (drawCursorAsBlock) {
+                if (context.cursorPosition == blpos + bllen - 1) {
+                    drawCursorAsBlock = false;
+                } else {
+                    QTextLayout::FormatRange o;
+                    o.start = context.cursorPosition - blpos;
+                    o.length = 1;
+                    o.format.setForeground(palette().base());
+                    o.format.setBackground(palette().text());
+                    selections.append(o);
+                }
+            }
+
+            const bool hasPreedit = !layout->preeditAreaText().isEmpty();
+            if (hasPreedit
+                    || !drawCachedBlock(&painter, block, offset, m_glyphRevision, textColor,
+                                        m_glyphCaches, selections, er.right() + 1))
+                layout->draw(&painter, offset, selections, er);
+
+            if ((drawCursor && !drawCursorAsBlock)
+                    || (editable && context.cursorPosition < -1 && hasPreedit)) {
+                int cpos = context.cursorPosition;
+                if (cpos < -1)
+                    cpos = layout->preeditAreaPosition() - (cpos + 2);
+                else
+                    cpos -= blpos;
+                layout->drawCursor(&painter, offset, cpos, cursorWidth());
+            }
+        }
+
+        ++paintedBlocks;
+        offset.ry() += r.height();
+        if (offset.y() > viewportRect.height())
+            break;
+        block = block.next();
+    }
+
+    if (backgroundVisible() && !block.isValid() && offset.y() <= er.bottom()
+            && (centerOnScroll() || verticalScrollBar()->maximum() == verticalScrollBar()->minimum())) {
+        painter.fillRect(QRect(QPoint(int(er.left()), int(offset.y())), er.bottomRight()), palette().window());
+    }
+
+    m_glyphCaches->trim(qMax(MinCachedBlocks, CachedBlocksPerPainted * paintedBlocks));
+}
+
+PythonBulkEdit::PythonBulkEdit(PythonEditor *editor)
+    : m_editor(editor)
+{
+    if (m_editor)
+        m_editor->beginBulkEdit();
+}
+
+PythonBulkEdit::~PythonBulkEdit()
+{ finish(); }
+
+void PythonBulkEdit::finish()
+{
+    if (m_editor) {
+        m_editor->endBulkEdit();
+        m_editor = 0;
+    }
+}
@@ -1,19 +1,61 @@
 #pragma once
 
 #include "pythoneditor_global.h"
+#include "pythonsymbolindex.h"
 
+#include <QColor>
 #include <QPlainTextEdit>
+#include <QVector>
 
 namespace PyEditor {
     namespace Internal {
+        class GlyphCacheList;
+        class LatencyRecorder;
         class PythonHighlighter;
     }
 }
 
+class PythonLanguageProfile;
+
+/**
+ * @brief Single token of exported token stream, four packed 32-bit integers
+ *
+ * Offset and length count UTF-16 code units, as QString and QTextDocument
+ * positions do. They equal Python str indices only while text has no
+ * characters outside the Basic Multilingual Plane (e.g. emoji), each of
+ * which takes two units.
+ */
+struct PythonToken
+{
+    qint32 offset;  // UTF-16 position in document or in tokenized source
+    qint32 length;  // UTF-16 code units
+    qint32 format;  // PythonEditor::Format
+    qint32 state;   // scanner state after the token
+};
+
+/**
+ * @brief Input latency statistics, all times are in microseconds
+ */
+class PYTHONEDITORSHARED_EXPORT PythonLatencyReport
+{
+public:
+    int samples = 0;
+
+    // input event to the end of the following viewport paint
+    qint64 p50 = 0;
+    qint64 p99 = 0;
+    qint64 max = 0;
+
+    qint64 editAverage = 0;         // input handling: document change, highlighting, layout
+    qint64 highlightAverage = 0;    // part of editAverage spent in highlightBlock()
+    qint64 paintAverage = 0;
+};
+
 class PYTHONEDITORSHARED_EXPORT PythonEditor : public QPlainTextEdit
 {
 public:
     PythonEditor(QWidget *parent = 0);
+    ~PythonEditor();
 
     enum Format {
         Number = 0,
@@ -46,6 +88,75 @@ public:
 
     void setFormatStyle(PythonEditor::Format fmt, const QColor &color, PythonEditor::FontStyle style = PythonEditor::Normal);
 
+    void setLanguageProfile(const PythonLanguageProfile &profile);
+    PythonLanguageProfile languageProfile() const;
+
+    void beginBulkEdit();
+    void endBulkEdit();
+
+    QVector<PythonToken> tokens(int firstBlock, int lastBlock) const;
+    static QVector<PythonToken> tokenize(const QString &source, int initialState = 0,
+                                         const PythonLanguageProfile *profile = 0);
+
+    void setMarkOccurrences(bool enabled);
+    bool markOccurrences() const;
+    void setOccurrencesBackground(const QColor &color);
+
+    void setSymbolIndex(PythonSymbolIndex *index);
+    PythonSymbolIndex *symbolIndex() const;
+    QList<PythonSymbol> findSymbols(const QString &prefix, int limit = 50) const;
+
+    void setLatencyRecording(bool enabled);
+    bool isLatencyRecording() const;
+    void resetLatencyRecording();
+    PythonLatencyReport latencyReport() const;
+    QStringList recordedSession() const;
+
+    void setGlyphCaching(bool enabled);
+    bool glyphCaching() const;
+
+    qint64 highlighterMemoryUsage() const;
+
+protected:
+    void keyPressEvent(QKeyEvent *e) override;
+    void inputMethodEvent(QInputMethodEvent *e) override;
+    void insertFromMimeData(const QMimeData *source) override;
+    void paintEvent(QPaintEvent *e) override;
+    void changeEvent(QEvent *e) override;
+
 private:
+    void updateOccurrences();
+    void recordCursorMove();
+    void paintBlocks(QPaintEvent *e);
+
     PyEditor::Internal::PythonHighlighter *m_highlighter;
+    PyEditor::Internal::LatencyRecorder *m_latency;
+
+    PythonSymbolIndex *m_symbolIndex = 0;
+
+    bool m_markOccurrences = true;
+    bool m_hasOccurrenceSelections = false;
+    QColor m_occurrencesBackground = QColor(180, 238, 180);
+
+    PyEditor::Internal::GlyphCacheList *m_glyphCaches;
+    bool m_glyphCaching = true;
+    int m_glyphRevision = 0;
+    uint m_layoutKey = 0;
+};
+
+/**
+ * @brief Scoped bulk edit transaction, see PythonEditor::beginBulkEdit()
+ */
+class PYTHONEDITORSHARED_EXPORT PythonBulkEdit
+{
+public:
+    explicit PythonBulkEdit(PythonEditor *editor);
+    ~PythonBulkEdit();
+
+    void finish();
+
+private:
+    Q_DISABLE_COPY(PythonBulkEdit)
+
+    PythonEditor *m_editor;
 };
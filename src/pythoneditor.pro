@@ -14,9 +14,19 @@ HEADERS += \
     pythoneditor.h \
     pythonscanner.h \
     pythonhighlighter.h \
-    pythonformattoken.h
+    pythonformattoken.h \
+    pythonsymbolindex.h \
+    pythonlatencyrecorder.h \
+    pythonblockarena.h \
+    pythonidentifiertable.h \
+    pythonlanguageprofile.h
 
 SOURCES += \
     pythoneditor.cpp \
     pythonscanner.cpp \
-    pythonhighlighter.cpp
+    pythonhighlighter.cpp \
+    pythonsymbolindex.cpp \
+    pythonlatencyrecorder.cpp \
+    pythonblockarena.cpp \
+    pythonidentifiertable.cpp \
+    pythonlanguageprofile.cpp
@@ -41,7 +41,7 @@ public:
         : m_format(format), m_position(position), m_length(length)
     {}
 
-    bool isEndOfBlock() { return m_position == -1; }
+    bool isEndOfBlock() const { return m_position == -1; }
 
     PythonEditor::Format format() const { return m_format; }
     int begin() const { return m_position; }
@@ -34,8 +34,14 @@
  */
 
 #include "pythonhighlighter.h"
+#include "pythonlatencyrecorder.h"
 #include "pythonscanner.h"
 
+#include <QElapsedTimer>
+
+#include <QTextBlock>
+#include <QTextDocument>
+
 namespace PyEditor {
 namespace Internal {
 
@@ -57,6 +63,22 @@ namespace Internal {
  * @endcode
  */
 
+static bool isNameFormat(PythonEditor::Format format)
+{
+    switch (format) {
+        case PythonEditor::Identifier:
+        case PythonEditor::ClassField:
+        case PythonEditor::MagicAttr:
+        case PythonEditor::Type:
+        case PythonEditor::ImportedModule:
+        case PythonEditor::ClassDef:
+        case PythonEditor::FunctionDef:
+            return true;
+        default:
+            return false;
+    }
+}
+
 static void fillFormat(QTextCharFormat &format, const QColor &color, PythonEditor::FontStyle style = PythonEditor::Normal)
 {
     format.setForeground(color);
@@ -77,8 +99,89 @@ static void fillFormat(QTextCharFormat &format, const QColor &color, PythonEdito
     }
 }
 
+// Arena owner is stored in front of every PythonBlockData
+static const size_t ArenaHeaderSize = BlockArena::Granularity;
+Q_STATIC_ASSERT(ArenaHeaderSize >= sizeof(BlockArena *));
+
+void *PythonBlockData::operator new(size_t size, BlockArena *arena)
+{
+    char *p = static_cast<char *>(arena->allocate(size + ArenaHeaderSize));
+    *reinterpret_cast<BlockArena **>(p) = arena;
+    return p + ArenaHeaderSize;
+}
+
+void PythonBlockData::operator delete(void *p, size_t size)
+{
+    char *block = static_cast<char *>(p) - ArenaHeaderSize;
+    BlockArena *arena = *reinterpret_cast<BlockArena **>(block);
+    arena->deallocate(block, size + ArenaHeaderSize);
+}
+
+void PythonBlockData::operator delete(void *p, BlockArena *arena)
+{
+    arena->deallocate(static_cast<char *>(p) - ArenaHeaderSize, sizeof(PythonBlockData) + ArenaHeaderSize);
+}
+
+void GlyphCache::clear()
+{
+    QVector<Run>().swap(runs);
+    revision = -1;
+    layoutOnly = false;
+    if (list)
+        list->remove(this);
+    bytes = 0;
+}
+
+/**
+ * @brief Puts filled cache in front of the list
+ */
+void GlyphCacheList::touch(GlyphCache *cache)
+{
+    if (cache->list)
+        cache->list->remove(cache);
+
+    cache->list = this;
+    cache->prev = 0;
+    cache->next = m_first;
+    if (m_first)
+        m_first->prev = cache;
+    else
+        m_last = cache;
+    m_first = cache;
+
+    ++m_count;
+    m_bytes += cache->bytes;
+}
+
+void GlyphCacheList::remove(GlyphCache *cache)
+{
+    if (cache->prev)
+        cache->prev->next = cache->next;
+    else
+        m_first = cache->next;
+    if (cache->next)
+        cache->next->prev = cache->prev;
+    else
+        m_last = cache->prev;
+
+    cache->list = 0;
+    cache->prev = cache->next = 0;
+    --m_count;
+    m_bytes -= cache->bytes;
+}
+
+/**
+ * @brief Frees least recently painted caches beyond maxCount
+ */
+void GlyphCacheList::trim(int maxCount)
+{
+    while (m_count > maxCount)
+        m_last->clear();
+}
+
 PythonHighlighter::PythonHighlighter(QTextDocument *parent)
     : QSyntaxHighlighter(parent)
+    , m_arena(new BlockArena)
 {
     fillFormat(formats[PythonEditor::Number],          "brown");
     fillFormat(formats[PythonEditor::String],          "magenta");
@@ -98,12 +201,109 @@ PythonHighlighter::PythonHighlighter(QTextDocument *parent)
     fillFormat(formats[PythonEditor::FunctionDef],     "olive",            PythonEditor::BoldItalic);
 }
 
+/**
+ * Block data outlives highlighter: document deletes it later, when arena
+ * frees itself with the last block
+ */
+PythonHighlighter::~PythonHighlighter()
+{
+    m_arena->release();
+}
+
 void PythonHighlighter::setFormatStyle(PythonEditor::Format fmt, const QColor &color, PythonEditor::FontStyle style)
 {
     if (fmt != PythonEditor::FormatsAmount)
         fillFormat(formats[fmt], color, style);
 }
 
+/**
+ * @brief Sets names highlighted as keywords, builtins and magic attributes,
+ * rehighlights document with them
+ */
+void PythonHighlighter::setLanguageProfile(const PythonLanguageProfile &profile)
+{
+    m_languageProfile = profile;
+    rehighlight();
+}
+
+/**
+ * @brief Suspends incremental highlighting until the matching endBulkEdit()
+ *
+ * QSyntaxHighlighter re-lexes the changed blocks on every contentsChange() of
+ * the document. Inside a bulk edit this reaction is disconnected and only the
+ * union of the changed ranges is remembered, so replace-all, paste or a
+ * scripted multi-step edit costs a single highlight pass. Calls may be nested.
+ */
+void PythonHighlighter::beginBulkEdit()
+{
+    if (m_bulkEditDepth++ > 0)
+        return;
+
+    QTextDocument *doc = document();
+    if (!doc)
+        return;
+
+    disconnect(doc, SIGNAL(contentsChange(int,int,int)),
+               this, SLOT(_q_reformatBlocks(int,int,int)));
+    m_bulkEditConnection = connect(doc, &QTextDocument::contentsChange, this,
+                                   [this](int position, int charsRemoved, int charsAdded) {
+        onBulkContentsChange(position, charsRemoved, charsAdded);
+    });
+}
+
+/**
+ * @brief Resumes incremental highlighting and rehighlights accumulated range
+ *
+ * The dirty range is handed to QSyntaxHighlighter in one go, so blocks are
+ * rescanned once and the block state propagation past the range still stops
+ * as soon as the state of a block doesn't change.
+ */
+void PythonHighlighter::endBulkEdit()
+{
+    if (m_bulkEditDepth == 0 || --m_bulkEditDepth > 0)
+        return;
+
+    QTextDocument *doc = document();
+    if (!doc)
+        return;
+
+    disconnect(m_bulkEditConnection);
+    connect(doc, SIGNAL(contentsChange(int,int,int)),
+            this, SLOT(_q_reformatBlocks(int,int,int)));
+
+    if (m_dirtyFrom < 0)
+        return;
+
+    const int from = m_dirtyFrom;
+    const int to = qMin(m_dirtyTo, doc->characterCount());
+    m_dirtyFrom = m_dirtyTo = -1;
+
+    QMetaObject::invokeMethod(this, "_q_reformatBlocks",
+                              Q_ARG(int, from), Q_ARG(int, 0), Q_ARG(int, qMax(0, to - from)));
+}
+
+/**
+ * @brief Merges single document change into the dirty range of bulk edit
+ */
+void PythonHighlighter::onBulkContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    const int changeEnd = position + charsAdded;
+    if (m_dirtyFrom < 0) {
+        m_dirtyFrom = position;
+        m_dirtyTo = changeEnd;
+        return;
+    }
+
+    // text after the change moves, text inside removed part collapses
+    if (m_dirtyTo >= position + charsRemoved)
+        m_dirtyTo += charsAdded - charsRemoved;
+    else if (m_dirtyTo > position)
+        m_dirtyTo = changeEnd;
+
+    m_dirtyFrom = qMin(m_dirtyFrom, position);
+    m_dirtyTo = qMax(m_dirtyTo, changeEnd);
+}
+
 /**
  * @brief PythonHighlighter::highlightBlock highlights single line of Python code
  * @param text is single line without EOLN symbol. Access to all block data
@@ -115,10 +315,21 @@ void PythonHighlighter::setFormatStyle(PythonEditor::Format fmt, const QColor &c
  */
 void PythonHighlighter::highlightBlock(const QString &text)
 {
+    QElapsedTimer timer;
+    const bool timed = m_latencyRecorder && m_latencyRecorder->isInputPending();
+    if (timed)
+        timer.start();
+
+    if (m_identifierIds.size() > m_identifierLimit)
+        compactIdentifiers();
+
     int initialState = previousBlockState();
     if (initialState == -1)
         initialState = 0;
     setCurrentBlockState(highlightLine(text, initialState));
+
+    if (timed)
+        m_latencyRecorder->addHighlightTime(timer.nsecsElapsed());
 }
 
 /**
@@ -129,65 +340,108 @@ void PythonHighlighter::highlightBlock(const QString &text)
  */
 int PythonHighlighter::highlightLine(const QString &text, int initialState)
 {
-    Scanner scanner(text.constData(), text.size());
-    scanner.setState(initialState);
+    PythonBlockData *data = static_cast<PythonBlockData *>(currentBlockUserData());
+    if (!data) {
+        data = new (m_arena) PythonBlockData(m_arena);
+        setCurrentBlockUserData(data);
+    }
+    data->identifiers.clear();
+    data->glyphCache.clear();
+
+    Tokenizer tokenizer(text.constData(), text.size(), initialState,
+                        m_languageProfile.identifierTable());
 
     FormatToken tk;
-    bool hasOnlyWhitespace = true;
-    while (!(tk = scanner.read()).isEndOfBlock()) {
-        PythonEditor::Format format = tk.format();
-        setFormat(tk.begin(), tk.length(), formats[format]);
-
-        if (format == PythonEditor::Keyword && hasOnlyWhitespace) {
-            switch (scanner.keywordKind(tk)) {
-                case Scanner::ImportOrFrom:
-                    highlightImport(scanner);
-                    break;
-                case  Scanner::Class:
-                    highlightDeclarationIdentifier(scanner, formats[PythonEditor::ClassDef]);
-                    break;
-                case Scanner::Def:
-                    highlightDeclarationIdentifier(scanner, formats[PythonEditor::FunctionDef]);
-                    break;
-            }
+    while (!(tk = tokenizer.read()).isEndOfBlock()) {
+        setFormat(tk.begin(), tk.length(), formats[tk.format()]);
+
+        if (isNameFormat(tk.format())) {
+            const IdentifierOccurrence occurrence = { internIdentifier(tokenizer.value(tk)), tk.begin(), tk.length() };
+            data->identifiers.append(occurrence);
         }
+    }
+
+    return tokenizer.state();
+}
 
-        if (format != PythonEditor::Whitespace)
-            hasOnlyWhitespace = false;
+/**
+ * @brief Returns interned id of identifier, which contains or touches
+ * given position of block, or -1
+ */
+int PythonHighlighter::identifierAt(const QTextBlock &block, int positionInBlock)
+{
+    const PythonBlockData *data = static_cast<const PythonBlockData *>(block.userData());
+    if (!data)
+        return -1;
+
+    for (const IdentifierOccurrence &occurrence : data->identifiers) {
+        if (positionInBlock >= occurrence.position
+                && positionInBlock <= occurrence.position + occurrence.length)
+            return occurrence.id;
     }
 
+    return -1;
+}
 
-    return scanner.state();
+// estimated heap size of interned name: hash node, string header and text
+static qint64 identifierBytes(const QString &name)
+{
+    return 4 * sizeof(void *) + 24 + (name.size() + 1) * sizeof(QChar);
 }
 
-void PythonHighlighter::highlightDeclarationIdentifier(Scanner &scanner, const QTextCharFormat &format)
+/**
+ * @brief Maps identifier to small integer, so blocks store and compare ids only
+ */
+int PythonHighlighter::internIdentifier(const QString &name)
 {
-    FormatToken tk = scanner.read();
-    while (tk.format() == PythonEditor::Whitespace) {
-        setFormat(tk.begin(), tk.length(), formats[PythonEditor::Whitespace]);
-        tk = scanner.read();
-    }
+    QHash<QString, int>::const_iterator it = m_identifierIds.constFind(name);
+    if (it != m_identifierIds.constEnd())
+        return it.value();
 
-    if (tk.isEndOfBlock())
-        return;
-    if (tk.format() == PythonEditor::Identifier)
-        setFormat(tk.begin(), tk.length(), format);
-    else
-        setFormat(tk.begin(), tk.length(), formats[tk.format()]);
+    const int id = m_identifierIds.size();
+    m_identifierIds.insert(name, id);
+    m_identifierBytes += identifierBytes(name);
+    return id;
 }
 
 /**
- * @brief Highlights rest of line as import directive
+ * @brief Drops interned names no block refers to and renumbers ids of the rest
+ *
+ * Typing interns every prefix of a new name and deleted text leaves its names
+ * behind, so the table is compacted when it doubles past the size of the last
+ * compaction. Blocks are renumbered in place, ids stay comparable.
  */
-void PythonHighlighter::highlightImport(Scanner &scanner)
+void PythonHighlighter::compactIdentifiers()
 {
-    FormatToken tk;
-    while (!(tk = scanner.read()).isEndOfBlock()) {
-        PythonEditor::Format format = tk.format();
-        if (tk.format() == PythonEditor::Identifier)
-            format = PythonEditor::ImportedModule;
-        setFormat(tk.begin(), tk.length(), formats[format]);
+    QVector<int> newIds(m_identifierIds.size(), -1);
+    int count = 0;
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        PythonBlockData *data = static_cast<PythonBlockData *>(block.userData());
+        if (!data)
+            continue;
+
+        for (IdentifierOccurrence &occurrence : data->identifiers) {
+            int &newId = newIds[occurrence.id];
+            if (newId < 0)
+                newId = count++;
+            occurrence.id = newId;
+        }
+    }
+
+    QHash<QString, int> ids;
+    ids.reserve(count);
+    m_identifierBytes = 0;
+    for (QHash<QString, int>::const_iterator it = m_identifierIds.constBegin();
+         it != m_identifierIds.constEnd(); ++it) {
+        const int newId = newIds.at(it.value());
+        if (newId >= 0) {
+            ids.insert(it.key(), newId);
+            m_identifierBytes += identifierBytes(it.key());
+        }
     }
+
+    m_identifierIds.swap(ids);
+    m_identifierLimit = qMax(int(MinIdentifierLimit), 2 * count);
 }
 
 } // namespace Internal
@@ -25,30 +25,163 @@
 
 #pragma once
 
+#include "pythonblockarena.h"
 #include "pythonformattoken.h"
+#include "pythonlanguageprofile.h"
 
+#include <QColor>
+#include <QGlyphRun>
+#include <QHash>
 #include <QSyntaxHighlighter>
+#include <QTextBlockUserData>
+#include <QVector>
 
 namespace PyEditor {
 namespace Internal {
 
-class Scanner;
+/**
+ * @brief Identifier token of block, id is interned by PythonHighlighter
+ */
+struct IdentifierOccurrence
+{
+    int id;
+    int position;
+    int length;
+};
+
+class GlyphCacheList;
+
+/**
+ * @brief Shaped text of block, painted by PythonEditor while the key matches
+ *
+ * Filled caches are linked into GlyphCacheList of editor, which frees the
+ * least recently painted ones, so only blocks near the viewport keep glyphs.
+ */
+struct GlyphCache
+{
+    struct Run {
+        QGlyphRun glyphs;
+        QColor color;
+    };
+
+    GlyphCache() = default;
+    GlyphCache(const GlyphCache &other) = delete;
+    void operator=(const GlyphCache &other) = delete;
+    ~GlyphCache() { clear(); }
+
+    void clear();
+
+    QVector<Run> runs;
+    bool layoutOnly = false;    // block has decorated formats, QTextLayout draws it
+    int blockRevision = -1;     // QTextBlock::revision() of cached text
+    int revision = -1;      // editor paint revision (font, palette, styles), -1 if empty
+    qreal lineWidth = -1;
+    int lineCount = 0;
+    qint64 bytes = 0;       // estimated heap size of runs
+
+    GlyphCacheList *list = 0;
+    GlyphCache *prev = 0;
+    GlyphCache *next = 0;
+};
+
+/**
+ * @brief Filled glyph caches of editor, most recently painted first
+ *
+ * Destroying the list frees all caches, so block data outliving the editor
+ * doesn't refer to it.
+ */
+class GlyphCacheList
+{
+    GlyphCacheList(const GlyphCacheList &other) = delete;
+    void operator=(const GlyphCacheList &other) = delete;
+
+public:
+    GlyphCacheList() = default;
+    ~GlyphCacheList() { trim(0); }
+
+    void touch(GlyphCache *cache);
+    void remove(GlyphCache *cache);
+    void trim(int maxCount);
+
+    int count() const { return m_count; }
+    qint64 bytes() const { return m_bytes; }
+
+private:
+    GlyphCache *m_first = 0;
+    GlyphCache *m_last = 0;
+    int m_count = 0;
+    qint64 m_bytes = 0;
+};
+
+/**
+ * @brief Per-block highlighter data, kept in sync with block text by highlightBlock()
+ *
+ * Lives in BlockArena of document: created with new (arena) PythonBlockData(arena),
+ * deleted by QTextDocument with plain delete, which returns memory to arena.
+ * Glyph runs of glyphCache are the exception: QGlyphRun data is allocated by
+ * Qt, so only caches of blocks near the viewport are kept filled.
+ */
+class PythonBlockData : public QTextBlockUserData
+{
+public:
+    explicit PythonBlockData(BlockArena *arena) : identifiers(arena) {}
+
+    static void *operator new(size_t size, BlockArena *arena);
+    static void operator delete(void *p, size_t size);
+    static void operator delete(void *p, BlockArena *arena);
+
+    ArenaVector<IdentifierOccurrence> identifiers;
+    GlyphCache glyphCache;
+};
+
+class LatencyRecorder;
 
 class PythonHighlighter : public QSyntaxHighlighter
 {
 public:
     PythonHighlighter(QTextDocument *parent = 0);
+    ~PythonHighlighter();
 
     void setFormatStyle(PythonEditor::Format fmt, const QColor &color, PythonEditor::FontStyle style = PythonEditor::Normal);
 
+    void setLanguageProfile(const PythonLanguageProfile &profile);
+    PythonLanguageProfile languageProfile() const { return m_languageProfile; }
+
+    void beginBulkEdit();
+    void endBulkEdit();
+    int bulkEditDepth() const { return m_bulkEditDepth; }
+
+    static int identifierAt(const QTextBlock &block, int positionInBlock);
+
+    void setLatencyRecorder(LatencyRecorder *recorder) { m_latencyRecorder = recorder; }
+
+    qint64 memoryUsage() const { return m_arena->bytesUsed() + m_identifierBytes; }
+
 private:
+    enum { MinIdentifierLimit = 4096 };
+
+    int internIdentifier(const QString &name);
+    void compactIdentifiers();
+
+    void onBulkContentsChange(int position, int charsRemoved, int charsAdded);
+
     void highlightBlock(const QString &text) override;
     int  highlightLine(const QString &text, int initialState);
-    void highlightDeclarationIdentifier(Scanner &scanner, const QTextCharFormat &format);
-    void highlightImport(Scanner &scanner);
 
 private:
     QTextCharFormat formats[PythonEditor::FormatsAmount];
+    PythonLanguageProfile m_languageProfile;
+
+    BlockArena *m_arena;
+    QHash<QString, int> m_identifierIds;
+    int m_identifierLimit = MinIdentifierLimit;
+    qint64 m_identifierBytes = 0;   // estimated heap size of m_identifierIds
+    LatencyRecorder *m_latencyRecorder = 0;
+
+    int m_bulkEditDepth = 0;
+    int m_dirtyFrom = -1;
+    int m_dirtyTo = -1;
+    QMetaObject::Connection m_bulkEditConnection;
 };
 
 } // namespace Internal
@@ -0,0 +1,168 @@
+#include "pythonidentifiertable.h"
+#include "pythonlanguageprofile.h"
+
+namespace PyEditor {
+namespace Internal {
+
+// Name lists are plain constant arrays, so they need no initialization at
+// run time. Compiled tables are immutable once built.
+
+static const char *const python2Keywords[] = {
+    "and", "as", "assert", "break", "class", "continue", "def", "del", "elif",
+    "else", "except", "exec", "finally", "for", "from", "global", "if", "import",
+    "in", "is", "lambda", "not", "or", "pass", "print", "raise", "return", "try",
+    "while", "with", "yield", 0
+};
+
+static const char *const python3Keywords[] = {
+    "and", "as", "assert", "async", "await", "break", "class", "continue",
+    "def", "del", "elif", "else", "except", "finally", "for", "from", "global",
+    "if", "import", "in", "is", "lambda", "nonlocal", "not", "or", "pass",
+    "raise", "return", "try", "while", "with", "yield", 0
+};
+
+// Cython additions to Python 3 keywords and C types
+static const char *const cythonKeywords[] = {
+    "cdef", "cpdef", "ctypedef", "cimport", "include", "extern", "inline",
+    "nogil", "gil", "public", "readonly", "api", "struct", "union", "enum",
+    "fused", "DEF", "IF", "ELIF", "ELSE", 0
+};
+
+static const char *const cythonTypes[] = {
+    "bint", "char", "short", "long", "float", "double", "signed", "unsigned",
+    "const", "void", "size_t", "Py_ssize_t", "Py_UCS4", "NULL", 0
+};
+
+// Python magic methods and attributes common to all versions
+static const char *const magics[] = {
+    // ctor & dtor
+    "__init__", "__del__",
+    // string conversion functions
+    "__str__", "__repr__",
+    // attribute access functions
+    "__setattr__", "__getattr__", "__delattr__",
+    // binary operators
+    "__add__", "__sub__", "__mul__", "__truediv__", "__floordiv__", "__mod__",
+    "__pow__", "__and__", "__or__", "__xor__", "__eq__", "__ne__", "__gt__",
+    "__lt__", "__ge__", "__le__", "__lshift__", "__rshift__", "__contains__",
+    // unary operators
+    "__pos__", "__neg__", "__inv__", "__abs__", "__len__",
+    // item operators like []
+    "__getitem__", "__setitem__", "__delitem__",
+    // other functions
+    "__hash__", "__call__", "__iter__", "__reversed__", "__divmod__", "__int__",
+    "__float__", "__complex__", "__index__", "__copy__", "__deepcopy__",
+    "__sizeof__", "__trunc__", "__format__",
+    // magic attributes
+    "__name__", "__module__", "__dict__", "__bases__", "__doc__", 0
+};
+
+static const char *const python2Magics[] = {
+    "__unicode__", "__getslice__", "__setslice__", "__delslice__", "__cmp__",
+    "__nonzero__", "__long__", "__hex__", "__oct__", 0
+};
+
+static const char *const python3Magics[] = {
+    "__new__", "__bool__", "__bytes__", "__next__", "__matmul__", "__round__",
+    "__enter__", "__exit__", "__await__", "__aiter__", "__anext__",
+    "__aenter__", "__aexit__", "__get__", "__set__", "__delete__",
+    "__set_name__", "__init_subclass__", "__class_getitem__", "__missing__",
+    "__getattribute__", "__dir__", "__fspath__",
+    "__qualname__", "__class__", "__slots__", "__annotations__", "__all__", 0
+};
+
+// Python built-in functions and objects
+static const char *const python2Builtins[] = {
+    "range", "xrange", "int", "float", "long", "hex", "oct", "chr", "ord",
+    "len", "abs", "None", "True", "False", 0
+};
+
+static const char *const python3Builtins[] = {
+    "range", "int", "float", "hex", "oct", "chr", "ord", "len", "abs", "print",
+    "exec", "str", "bytes", "bool", "list", "dict", "set", "tuple", "object",
+    "super", "isinstance", "None", "True", "False", "NotImplemented",
+    "Ellipsis", 0
+};
+
+static void insertNames(QHash<QString, PythonEditor::Format> &table,
+                        const char *const *names, PythonEditor::Format format)
+{
+    for (; *names; ++names)
+        table.insert(QLatin1String(*names), format);
+}
+
+/**
+  returns names of language with their formats; where a name is in several
+  lists, builtins win over magics and magics over keywords
+  */
+QHash<QString, PythonEditor::Format> IdentifierTable::builtinNames(int language)
+{
+    QHash<QString, PythonEditor::Format> names;
+    if (language == PythonLanguageProfile::Python2) {
+        insertNames(names, python2Keywords, PythonEditor::Keyword);
+        insertNames(names, magics, PythonEditor::MagicAttr);
+        insertNames(names, python2Magics, PythonEditor::MagicAttr);
+        insertNames(names, python2Builtins, PythonEditor::Type);
+    } else {
+        insertNames(names, python3Keywords, PythonEditor::Keyword);
+        if (language == PythonLanguageProfile::Cython)
+            insertNames(names, cythonKeywords, PythonEditor::Keyword);
+        insertNames(names, magics, PythonEditor::MagicAttr);
+        insertNames(names, python3Magics, PythonEditor::MagicAttr);
+        insertNames(names, python3Builtins, PythonEditor::Type);
+        if (language == PythonLanguageProfile::Cython)
+            insertNames(names, cythonTypes, PythonEditor::Type);
+    }
+    names.insert(QLatin1String("self"), PythonEditor::ClassField);
+    return names;
+}
+
+IdentifierTable::IdentifierTable(const QHash<QString, PythonEditor::Format> &names)
+{
+    // power of two capacity with load factor at most 1/2
+    int capacity = 16;
+    while (capacity < names.size() * 2)
+        capacity *= 2;
+    m_mask = quint32(capacity - 1);
+    m_slots.fill(Slot{0, 0, 0, 0}, capacity);
+
+    int chars = 0;
+    for (auto it = names.cbegin(); it != names.cend(); ++it)
+        chars += it.key().size();
+    m_chars.reserve(chars);
+
+    for (auto it = names.cbegin(); it != names.cend(); ++it) {
+        const QString &name = it.key();
+        if (name.isEmpty() || it.value() == PythonEditor::Identifier)
+            continue;
+
+        const quint32 hash = hashName(name.constData(), name.size());
+        quint32 i = hash & m_mask;
+        while (m_slots.at(i).length != 0)
+            i = (i + 1) & m_mask;
+
+        Slot &slot = m_slots[i];
+        slot.hash = hash;
+        slot.offset = m_chars.size();
+        slot.length = name.size();
+        slot.format = it.value();
+        for (const QChar ch : name)
+            m_chars.append(ch);
+        m_maxLength = qMax(m_maxLength, name.size());
+    }
+}
+
+/**
+  returns table of Python 3 names, used by scanners created without table;
+  it is built on first use, C++11 makes this initialization thread-safe and
+  independent of static initialization order of other translation units
+  */
+const IdentifierTable *IdentifierTable::defaultTable()
+{
+    static const IdentifierTable python3Table(
+            IdentifierTable::builtinNames(PythonLanguageProfile::Python3));
+    return &python3Table;
+}
+
+} // namespace Internal
+} // namespace PythonEditor
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "pythoneditor.h"
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include <cstring>
+
+namespace PyEditor {
+namespace Internal {
+
+/**
+ * @brief The IdentifierTable class - names with their own formats (keywords,
+ * builtins, magic attributes) compiled to flat open-addressing hash table
+ *
+ * Names are kept in one pooled character buffer, slots store hash, offset
+ * and length of name. Lookup hashes characters right in the scanned text,
+ * so classification of identifier allocates nothing and doesn't depend on
+ * the number of names. Table is immutable once built and can be shared by
+ * scanners in several threads.
+ */
+class IdentifierTable
+{
+    IdentifierTable(const IdentifierTable &other) = delete;
+    void operator=(const IdentifierTable &other) = delete;
+
+public:
+    explicit IdentifierTable(const QHash<QString, PythonEditor::Format> &names);
+
+    PythonEditor::Format format(const QChar *text, int length) const
+    {
+        if (length > m_maxLength)
+            return PythonEditor::Identifier;
+
+        const quint32 hash = hashName(text, length);
+        const Slot *slots = m_slots.constData();
+        for (quint32 i = hash & m_mask; slots[i].length != 0; i = (i + 1) & m_mask) {
+            const Slot &slot = slots[i];
+            if (slot.hash == hash && slot.length == length
+                    && memcmp(m_chars.constData() + slot.offset, text,
+                              length * sizeof(QChar)) == 0)
+                return PythonEditor::Format(slot.format);
+        }
+        return PythonEditor::Identifier;
+    }
+
+    static QHash<QString, PythonEditor::Format> builtinNames(int language);
+    static const IdentifierTable *defaultTable();
+
+private:
+    struct Slot {
+        quint32 hash;
+        qint32 offset;
+        qint32 length;  // zero for empty slot
+        qint32 format;
+    };
+
+    static quint32 hashName(const QChar *text, int length)
+    {
+        quint32 hash = 2166136261u;     // FNV-1a
+        for (int i = 0; i < length; ++i) {
+            hash ^= text[i].unicode();
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    QVector<Slot> m_slots;
+    QVector<QChar> m_chars;
+    quint32 m_mask = 0;
+    int m_maxLength = 0;
+};
+
+} // namespace Internal
+} // namespace PythonEditor
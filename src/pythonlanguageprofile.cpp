@@ -0,0 +1,46 @@
+#include "pythonlanguageprofile.h"
+#include "pythonidentifiertable.h"
+
+using namespace PyEditor::Internal;
+
+PythonLanguageProfile::PythonLanguageProfile(Language language)
+    : m_language(language)
+    , m_names(IdentifierTable::builtinNames(language))
+    , m_table(new IdentifierTable(m_names))
+{
+}
+
+/**
+  adds names with given format, replacing format of names already in profile;
+  PythonEditor::Identifier removes special format of names. Only formats of
+  names are accepted: Keyword, Type, MagicAttr and ClassField, for others
+  nothing is changed and false is returned.
+  */
+bool PythonLanguageProfile::addNames(const QStringList &names,
+                                     PythonEditor::Format format)
+{
+    switch (format) {
+        case PythonEditor::Keyword:
+        case PythonEditor::Type:
+        case PythonEditor::MagicAttr:
+        case PythonEditor::ClassField:
+        case PythonEditor::Identifier:
+            break;
+        default:
+            return false;
+    }
+
+    for (const QString &name : names) {
+        if (format == PythonEditor::Identifier)
+            m_names.remove(name);
+        else if (!name.isEmpty())
+            m_names.insert(name, format);
+    }
+    m_table.reset(new IdentifierTable(m_names));
+    return true;
+}
+
+PythonEditor::Format PythonLanguageProfile::format(const QString &name) const
+{
+    return m_table->format(name.constData(), name.size());
+}
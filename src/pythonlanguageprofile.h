@@ -0,0 +1,50 @@
+#pragma once
+
+#include "pythoneditor.h"
+
+#include <QHash>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+
+namespace PyEditor {
+    namespace Internal {
+        class IdentifierTable;
+    }
+}
+
+/**
+ * @brief The PythonLanguageProfile class - names highlighted as keywords,
+ * builtins and magic attributes for Python 2, Python 3 or Cython
+ *
+ * Custom names, e.g. keywords of a DSL, can be added on top of the built-in
+ * set. The profile is compiled to a lookup table as names are added, so the
+ * number of names doesn't affect highlighting speed. Copies share the table
+ * and keep it alive. Like other Qt value classes the profile is reentrant:
+ * a copy may be used in another thread, but one object mustn't be changed
+ * while other threads use it.
+ */
+class PYTHONEDITORSHARED_EXPORT PythonLanguageProfile
+{
+public:
+    enum Language {
+        Python2 = 0,
+        Python3,
+        Cython
+    };
+
+    explicit PythonLanguageProfile(Language language = Python3);
+
+    Language language() const { return m_language; }
+
+    bool addNames(const QStringList &names, PythonEditor::Format format);
+    PythonEditor::Format format(const QString &name) const;
+
+    const PyEditor::Internal::IdentifierTable *identifierTable() const
+    { return m_table.data(); }
+
+private:
+    Language m_language;
+    QHash<QString, PythonEditor::Format> m_names;
+    QSharedPointer<const PyEditor::Internal::IdentifierTable> m_table;
+};
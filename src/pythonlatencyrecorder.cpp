@@ -0,0 +1,203 @@
+#include "pythonlatencyrecorder.h"
+
+#include <QInputMethodEvent>
+#include <QKeyEvent>
+#include <QUrl>
+
+#include <algorithm>
+
+namespace PyEditor {
+namespace Internal {
+
+static qint64 toUsecs(qint64 nsecs)
+{ return nsecs / 1000; }
+
+static QString encodeText(const QString &text)
+{ return QString::fromLatin1(QUrl::toPercentEncoding(text)); }
+
+void LatencyRecorder::setEnabled(bool enabled, int cursorPosition)
+{
+    if (m_enabled == enabled)
+        return;
+
+    m_enabled = enabled;
+    if (m_enabled)
+        reset(cursorPosition);
+}
+
+void LatencyRecorder::reset(int cursorPosition)
+{
+    m_clock.start();
+    m_inputStart = m_editStart = m_inputEnd = m_paintStart = m_lastEvent = -1;
+    m_hasTimestampOffset = false;
+    m_highlight = 0;
+    m_samples.clear();
+    m_nextSample = 0;
+    m_session.clear();
+    addSessionLine(QLatin1String("cursor"), QStringList() << QString::number(cursorPosition));
+}
+
+/**
+ * Session line is tab-separated: kind, milliseconds since previous event,
+ * then event fields, text is percent-encoded
+ */
+void LatencyRecorder::addSessionLine(const QString &kind, const QStringList &fields)
+{
+    const qint64 now = m_clock.elapsed();
+    const qint64 delay = m_lastEvent < 0 ? 0 : now - m_lastEvent;
+    m_lastEvent = now;
+    m_session.append(QStringList(QStringList() << kind << QString::number(delay) << fields).join(QLatin1Char('\t')));
+}
+
+void LatencyRecorder::keyPressed(const QKeyEvent *event)
+{
+    addSessionLine(QLatin1String("key"), QStringList()
+                   << QString::number(event->key())
+                   << QString::number(int(event->modifiers()))
+                   << encodeText(event->text()));
+}
+
+void LatencyRecorder::inputMethodCommitted(const QInputMethodEvent *event)
+{
+    textInserted(event->commitString());
+}
+
+void LatencyRecorder::textInserted(const QString &text)
+{
+    if (!text.isEmpty())
+        addSessionLine(QLatin1String("text"), QStringList() << encodeText(text));
+}
+
+/**
+  cursor moved not by recorded input: mouse click, selection or API call;
+  anchor is the other end of selection
+  */
+void LatencyRecorder::cursorMoved(int position, int anchor)
+{
+    QStringList fields;
+    fields << QString::number(position);
+    if (anchor != position)
+        fields << QString::number(anchor);
+    addSessionLine(QLatin1String("cursor"), fields);
+}
+
+/**
+  clipboard text used by the following paste, replay puts it to clipboard
+  */
+void LatencyRecorder::textPasted(const QString &text)
+{
+    addSessionLine(QLatin1String("clipboard"), QStringList() << encodeText(text));
+}
+
+/**
+  input handling starts; timestamp is the one of input event or 0 if unknown
+  */
+void LatencyRecorder::inputStarted(ulong timestamp)
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    qint64 start = now;
+    if (timestamp != 0) {
+        // Event timestamps come from window system clock with unknown origin,
+        // the smallest difference to our clock seen is taken as no queueing
+        const qint64 offset = now / 1000000 - qint64(timestamp);
+        if (!m_hasTimestampOffset || offset < m_timestampOffset) {
+            m_timestampOffset = offset;
+            m_hasTimestampOffset = true;
+        }
+        start = qMax<qint64>(0, now - (offset - m_timestampOffset) * 1000000);
+    }
+
+    m_savedInputStart = m_inputStart;
+    m_savedEditStart = m_editStart;
+    m_savedInputEnd = m_inputEnd;
+    m_savedHighlight = m_highlight;
+
+    // input isn't painted yet, latency counts from the earliest one
+    if (m_inputStart < 0) {
+        m_inputStart = start;
+        m_editStart = now;
+        m_highlight = 0;
+    } else {
+        m_inputStart = qMin(m_inputStart, start);
+    }
+    m_inputEnd = -1;
+}
+
+void LatencyRecorder::inputFinished()
+{
+    if (m_inputStart >= 0)
+        m_inputEnd = m_clock.nsecsElapsed();
+}
+
+/**
+  input had no visible effect, so no paint follows it: forget it, keeping
+  input pending before it, otherwise the next paint would count user's pause
+  */
+void LatencyRecorder::inputCancelled()
+{
+    m_inputStart = m_savedInputStart;
+    m_editStart = m_savedEditStart;
+    m_inputEnd = m_savedInputEnd;
+    m_highlight = m_savedHighlight;
+}
+
+void LatencyRecorder::paintStarted()
+{
+    m_paintStart = m_clock.nsecsElapsed();
+}
+
+void LatencyRecorder::paintFinished()
+{
+    if (m_inputStart < 0 || m_inputEnd < 0 || m_paintStart < m_inputEnd)
+        return;
+
+    const qint64 now = m_clock.nsecsElapsed();
+    const Sample sample = {
+        now - m_inputStart,
+        m_inputEnd - m_editStart,
+        m_highlight,
+        now - m_paintStart
+    };
+
+    if (m_samples.size() < MaxSamples)
+        m_samples.append(sample);
+    else
+        m_samples[m_nextSample] = sample;
+    m_nextSample = (m_nextSample + 1) % MaxSamples;
+
+    m_inputStart = m_editStart = m_inputEnd = -1;
+    m_highlight = 0;
+}
+
+PythonLatencyReport LatencyRecorder::report() const
+{
+    PythonLatencyReport report;
+    report.samples = m_samples.size();
+    if (m_samples.isEmpty())
+        return report;
+
+    QVector<qint64> totals;
+    totals.reserve(m_samples.size());
+    qint64 edit = 0;
+    qint64 highlight = 0;
+    qint64 paint = 0;
+    for (const Sample &sample : m_samples) {
+        totals.append(sample.total);
+        edit += sample.edit;
+        highlight += sample.highlight;
+        paint += sample.paint;
+    }
+    std::sort(totals.begin(), totals.end());
+
+    const int count = totals.size();
+    report.p50 = toUsecs(totals.at((count - 1) * 50 / 100));
+    report.p99 = toUsecs(totals.at((count - 1) * 99 / 100));
+    report.max = toUsecs(totals.last());
+    report.editAverage = toUsecs(edit / count);
+    report.highlightAverage = toUsecs(highlight / count);
+    report.paintAverage = toUsecs(paint / count);
+    return report;
+}
+
+} // namespace Internal
+} // namespace PythonEditor
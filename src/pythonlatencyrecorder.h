@@ -0,0 +1,82 @@
+#pragma once
+
+#include "pythoneditor.h"
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QVector>
+
+class QInputMethodEvent;
+class QKeyEvent;
+
+namespace PyEditor {
+namespace Internal {
+
+/**
+ * @brief The LatencyRecorder class - measures input to paint latency of editor
+ *
+ * Latency of input event is the time from its timestamp (time spent in event
+ * queue behind slow paint or highlighting counts) to the end of the next
+ * viewport paint. Several inputs handled before one paint are measured from
+ * the earliest one, as user sees it. Inputs which change nothing (bare
+ * modifiers, preedit) are not measured. Input events, cursor moves made by other
+ * means (mouse, API) and clipboard text at paste are also kept as session
+ * lines, which can be replayed by tools/replay.
+ */
+class LatencyRecorder
+{
+public:
+    enum { MaxSamples = 8192 };
+
+    void setEnabled(bool enabled, int cursorPosition);
+    bool isEnabled() const { return m_enabled; }
+    bool isInputPending() const { return m_inputStart >= 0 && m_inputEnd < 0; }
+
+    void keyPressed(const QKeyEvent *event);
+    void inputMethodCommitted(const QInputMethodEvent *event);
+    void textInserted(const QString &text);
+    void cursorMoved(int position, int anchor);
+    void textPasted(const QString &text);
+    void inputStarted(ulong timestamp);
+    void inputFinished();
+    void inputCancelled();
+    void addHighlightTime(qint64 nsecs) { m_highlight += nsecs; }
+    void paintStarted();
+    void paintFinished();
+
+    PythonLatencyReport report() const;
+    QStringList session() const { return m_session; }
+    void reset(int cursorPosition);
+
+private:
+    struct Sample {
+        qint64 total;
+        qint64 edit;
+        qint64 highlight;
+        qint64 paint;
+    };
+
+    void addSessionLine(const QString &kind, const QStringList &fields);
+
+    bool m_enabled = false;
+    QElapsedTimer m_clock;
+    qint64 m_inputStart = -1;
+    qint64 m_editStart = -1;
+    qint64 m_inputEnd = -1;
+    qint64 m_timestampOffset = 0;  // milliseconds, clock minus event timestamp
+    qint64 m_savedInputStart = -1;  // pending input before the current one
+    qint64 m_savedEditStart = -1;
+    qint64 m_savedInputEnd = -1;
+    qint64 m_savedHighlight = 0;
+    bool m_hasTimestampOffset = false;
+    qint64 m_highlight = 0;
+    qint64 m_paintStart = -1;
+    qint64 m_lastEvent = -1;
+
+    QVector<Sample> m_samples;
+    int m_nextSample = 0;
+    QStringList m_session;
+};
+
+} // namespace Internal
+} // namespace PythonEditor
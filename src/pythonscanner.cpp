@@ -25,21 +25,35 @@
 
 #include "pythonscanner.h"
 
-#include <QSet>
-
 namespace PyEditor {
 namespace Internal {
 
 static const QChar C_SINGLE_QUOTE('\'');
 static const QChar C_DOUBLE_QUOTE('\"');
 
-Scanner::Scanner(const QChar *text, const int length)
-    : m_text(text), m_textLength(length), m_state(0)
+Scanner::Scanner(const QChar *text, const int length,
+                 const IdentifierTable *identifiers)
+    : m_text(text), m_textLength(length)
+    , m_identifiers(identifiers ? identifiers : IdentifierTable::defaultTable())
+    , m_state(0)
 {
 }
 
+/**
+  sets state saved from previous line; states passed by API callers may be
+  arbitrary, so only frames up to the first invalid one are kept
+  */
 void Scanner::setState(int state)
-{ m_state = state; }
+{
+    m_state = 0;
+    for (int i = 0; i < MaxStringFrames; ++i) {
+        const int frame = (state >> (i * FrameBits)) & FrameMask;
+        const int kind = frame & KindMask;
+        if (kind == Default || kind > MultiLineStringDoubleQuote)
+            break;
+        m_state |= frame << (i * FrameBits);
+    }
+}
 
 int Scanner::state() const
 { return m_state; }
@@ -47,16 +61,17 @@ int Scanner::state() const
 FormatToken Scanner::read()
 {
     setAnchor();
-    if (isEnd())
+    if (isEnd()) {
+        if (m_state != Default)
+            closeLine();
         return FormatToken();
-
-    switch (m_state) {
-        case StringSingleQuote:             return readStringLiteral(C_SINGLE_QUOTE);
-        case StringDoubleQuote:             return readStringLiteral(C_DOUBLE_QUOTE);
-        case MultiLineStringSingleQuote:    return readMultiLineStringLiteral(C_SINGLE_QUOTE);
-        case MultiLineStringDoubleQuote:    return readMultiLineStringLiteral(C_DOUBLE_QUOTE);
-        default:                            return onDefaultState();
     }
+
+    if (m_state == Default)
+        return onDefaultState();
+    if (topFrame() & ExpressionMask)
+        return onExpressionState();
+    return readStringBody();
 }
 
 QString Scanner::value(const FormatToken &tk) const
@@ -78,10 +93,14 @@ FormatToken Scanner::onDefaultState()
         return readFloatNumber();
 
     if (first == C_SINGLE_QUOTE || first == C_DOUBLE_QUOTE)
-        return readStringLiteral(first);
+        return readStringStart(first, 0);
 
-    if (first.isLetter() || first == '_')
+    if (first.isLetter() || first == '_') {
+        const int prefix = readStringPrefix();
+        if (prefix >= 0)
+            return readStringStart(peek(-1), prefix);
         return readIdentifier();
+    }
 
     if (first.isDigit())
         return readNumber();
@@ -99,124 +118,273 @@ FormatToken Scanner::onDefaultState()
 }
 
 /**
- * @brief Lexer::passEscapeCharacter
- * @return returns true if escape sequence doesn't end with newline
- */
-void Scanner::checkEscapeSequence(QChar quoteChar)
+  reads token inside replacement field of f-string, tracks bracket depth
+  to find the end of field and the start of format spec
+  */
+FormatToken Scanner::onExpressionState()
 {
-    if (peek() == '\\') {
+    const int frame = topFrame();
+    const int depth = (frame & ExpressionMask) >> ExpressionShift;
+    const QChar ch = peek();
+
+    if (ch == '{' || ch == '(' || ch == '[') {
         move();
-        QChar ch = peek();
-        if (ch == '\n' || ch.isNull())
-            m_state = quoteChar == '\'' ? StringSingleQuote :StringDoubleQuote;
+        const int newDepth = qMin(depth + 1, int(MaxExpressionDepth));
+        setTopFrame((frame & ~ExpressionMask) | (newDepth << ExpressionShift));
+        return FormatToken(PythonEditor::Braces, anchor(), length());
     }
+
+    if (ch == '}' || ch == ')' || ch == ']') {
+        move();
+        setTopFrame((frame & ~ExpressionMask) | ((depth - 1) << ExpressionShift));
+        return FormatToken(PythonEditor::Braces, anchor(), length());
+    }
+
+    if (ch == ':' && depth == 1) {
+        move();
+        setTopFrame((frame & ~ExpressionMask) | FormatSpec);
+        return FormatToken(PythonEditor::Operator, anchor(), length());
+    }
+
+    return onDefaultState();
+}
+
+static int prefixFlag(QChar ch)
+{
+    switch (ch.unicode()) {
+        case 'r': case 'R': return Scanner::RawPrefix;
+        case 'b': case 'B': return Scanner::BytesPrefix;
+        case 'f': case 'F': return Scanner::FormatPrefix;
+        case 'u': case 'U': return 0;
+    }
+
+    return -1;
+}
+
+static bool isQuote(QChar ch)
+{
+    return ch == C_SINGLE_QUOTE || ch == C_DOUBLE_QUOTE;
 }
 
 /**
-  reads single-line string literal, surrounded by ' or " quotes
+  checks if identifier, started by previous character, is string prefix;
+  if it is, moves past prefix and opening quote and returns prefix flags,
+  otherwise returns -1 and doesn't move
   */
-FormatToken Scanner::readStringLiteral(QChar quoteChar)
+int Scanner::readStringPrefix()
 {
-    QChar ch = peek();
-    if (ch == quoteChar && peek(1) == quoteChar) {
-        m_state = quoteChar == '\'' ? MultiLineStringSingleQuote : MultiLineStringDoubleQuote;
-        return readMultiLineStringLiteral(quoteChar);
-    }
+    const int first = prefixFlag(peek(-1));
+    if (first < 0)
+        return -1;
 
-    while (ch != quoteChar && !ch.isNull()) {
-        checkEscapeSequence(quoteChar);
+    if (isQuote(peek())) {
         move();
-        ch = peek();
+        return first;
     }
-    if (ch == quoteChar)
-        clearState();
+
+    const int second = prefixFlag(peek());
+    const int prefix = first | second;
+    if (first <= 0 || second <= 0 || !isQuote(peek(1))
+            || (prefix != (RawPrefix | BytesPrefix) && prefix != (RawPrefix | FormatPrefix)))
+        return -1;
+
     move();
-    return FormatToken(PythonEditor::String, anchor(), length());
+    move();
+    return prefix;
 }
 
 /**
-  reads multi-line string literal, surrounded by ''' or """ sequences
+  reads string literal after its opening quote, pushes string frame
   */
-FormatToken Scanner::readMultiLineStringLiteral(QChar quoteChar)
+FormatToken Scanner::readStringStart(QChar quoteChar, int prefix)
 {
+    bool multiLine = false;
+    if (peek() == quoteChar && peek(1) == quoteChar) {
+        move();
+        move();
+        multiLine = true;
+    }
+
+    if (frameCount() == MaxStringFrames)
+        return readInlineString(quoteChar, multiLine);
+
+    int kind = quoteChar == C_SINGLE_QUOTE ? StringSingleQuote : StringDoubleQuote;
+    if (multiLine)
+        kind += MultiLineStringSingleQuote - StringSingleQuote;
+    pushFrame(kind | prefix);
+    return readStringBody();
+}
+
+/**
+  reads literal part of string in top frame, up to closing quote, end of line
+  or replacement field of f-string
+  */
+FormatToken Scanner::readStringBody()
+{
+    const int frame = topFrame();
+    const int kind = frame & KindMask;
+    const QChar quoteChar = (kind == StringSingleQuote || kind == MultiLineStringSingleQuote)
+            ? C_SINGLE_QUOTE : C_DOUBLE_QUOTE;
+    const bool multiLine = kind >= MultiLineStringSingleQuote;
+    const bool format = frame & FormatPrefix;
+    const bool raw = frame & RawPrefix;
+
     for (;;) {
-        QChar ch = peek();
-        if (ch.isNull())
+        if (isEnd())
             break;
-        if (ch == quoteChar && peek(1) == quoteChar && peek(2) == quoteChar) {
-            clearState();
+
+        const QChar ch = peek();
+        if (ch == '\\') {
+            // backslash doesn't escape braces of f-string
+            if (format && (peek(1) == '{' || peek(1) == '}')) {
+                move();
+                continue;
+            }
+
+            // named unicode escape, its braces aren't replacement field
+            if (format && !raw && peek(1) == 'N' && peek(2) == '{') {
+                move();
+                move();
+                move();
+                while (!isEnd() && peek() != '}' && peek() != quoteChar)
+                    move();
+                if (peek() == '}')
+                    move();
+                continue;
+            }
+
             move();
+            if (isEnd()) {
+                m_continued = true;
+                break;
+            }
             move();
+            continue;
+        }
+
+        if (ch == quoteChar) {
             move();
-            break;
+            if (!multiLine) {
+                popFrame();
+                break;
+            }
+            if (peek() == quoteChar && peek(1) == quoteChar) {
+                move();
+                move();
+                popFrame();
+                break;
+            }
+            continue;
         }
+
+        if (format && (ch == '{' || ch == '}')) {
+            // doubled braces are escaped in literal part, but not in format spec
+            if (peek(1) == ch && !(frame & FormatSpec)) {
+                move();
+                move();
+                continue;
+            }
+
+            if (length() > 0)
+                break;
+
+            move();
+            if (ch == '{')
+                setTopFrame(frame | (1 << ExpressionShift));
+            else
+                setTopFrame(frame & ~FormatSpec);
+            return FormatToken(PythonEditor::Braces, anchor(), length());
+        }
+
+        move();
+    }
+
+    return FormatToken(PythonEditor::String, anchor(), length());
+}
+
+/**
+  reads string, which is nested too deep to keep it in state,
+  as plain literal up to closing quote or end of line
+  */
+FormatToken Scanner::readInlineString(QChar quoteChar, bool multiLine)
+{
+    while (!isEnd()) {
+        const QChar ch = peek();
         move();
+        if (ch == '\\') {
+            if (!isEnd())
+                move();
+        } else if (ch == quoteChar) {
+            if (!multiLine)
+                break;
+            if (peek() == quoteChar && peek(1) == quoteChar) {
+                move();
+                move();
+                break;
+            }
+        }
     }
 
     return FormatToken(PythonEditor::String, anchor(), length());
 }
 
+/**
+  single-quoted string can't continue on next line without backslash,
+  so its frame is dropped at the end of line
+  */
+void Scanner::closeLine()
+{
+    const int frame = topFrame();
+    const int kind = frame & KindMask;
+    if ((kind == StringSingleQuote || kind == StringDoubleQuote)
+            && !(frame & ExpressionMask) && !m_continued)
+        popFrame();
+}
+
+int Scanner::frameCount() const
+{
+    int count = 0;
+    while (count < MaxStringFrames && ((m_state >> (count * FrameBits)) & KindMask))
+        ++count;
+    return count;
+}
+
+int Scanner::topFrame() const
+{
+    const int count = frameCount();
+    return count ? (m_state >> ((count - 1) * FrameBits)) & FrameMask : 0;
+}
+
+void Scanner::setTopFrame(int frame)
+{
+    const int shift = (frameCount() - 1) * FrameBits;
+    m_state = (m_state & ~(FrameMask << shift)) | (frame << shift);
+}
+
+void Scanner::pushFrame(int frame)
+{
+    m_state |= frame << (frameCount() * FrameBits);
+}
+
+void Scanner::popFrame()
+{
+    const int shift = (frameCount() - 1) * FrameBits;
+    m_state &= ~(FrameMask << shift);
+}
+
 /**
   reads identifier and classifies it
   */
 FormatToken Scanner::readIdentifier()
 {
-    static const QSet<QString> keywords = {
-        "and", "as", "assert", "break", "class", "continue", "def", "del", "elif",
-        "else", "except", "exec", "finally", "for", "from", "global", "if", "import",
-        "in", "is", "lambda", "not", "or", "pass", "print", "raise", "return", "try",
-        "while", "with", "yield"
-    };
-
-    // List of Python magic methods and attributes
-    static const QSet<QString> magics = {
-        // ctor & dtor
-        "__init__", "__del__",
-        // string conversion functions
-        "__str__", "__repr__", "__unicode__",
-        // attribute access functions
-        "__setattr__", "__getattr__", "__delattr__",
-        // binary operators
-        "__add__", "__sub__", "__mul__", "__truediv__", "__floordiv__", "__mod__",
-        "__pow__", "__and__", "__or__", "__xor__", "__eq__", "__ne__", "__gt__",
-        "__lt__", "__ge__", "__le__", "__lshift__", "__rshift__", "__contains__",
-        // unary operators
-        "__pos__", "__neg__", "__inv__", "__abs__", "__len__",
-        // item operators like []
-        "__getitem__", "__setitem__", "__delitem__", "__getslice__", "__setslice__",
-        "__delslice__",
-        // other functions
-        "__cmp__", "__hash__", "__nonzero__", "__call__", "__iter__", "__reversed__",
-        "__divmod__", "__int__", "__long__", "__float__", "__complex__", "__hex__",
-        "__oct__", "__index__", "__copy__", "__deepcopy__", "__sizeof__", "__trunc__",
-        "__format__",
-        // magic attributes
-        "__name__", "__module__", "__dict__", "__bases__", "__doc__"
-    };
-
-    // List of python built-in functions and objects
-    static const QSet<QString> builtins = {
-        "range", "xrange", "int", "float", "long", "hex", "oct" "chr", "ord",
-        "len", "abs", "None", "True", "False"
-    };
-
     QChar ch = peek();
     while (ch.isLetterOrNumber() || ch == '_') {
         move();
         ch = peek();
     }
 
-    const QString v = QString(m_text + m_markedPosition, length());
-    PythonEditor::Format tkFormat = PythonEditor::Identifier;
-    if (v == "self")
-        tkFormat = PythonEditor::ClassField;
-    else if (builtins.contains(v))
-        tkFormat = PythonEditor::Type;
-    else if (magics.contains(v))
-        tkFormat = PythonEditor::MagicAttr;
-    else if (keywords.contains(v))
-        tkFormat = PythonEditor::Keyword;
-
+    const PythonEditor::Format tkFormat =
+            m_identifiers->format(m_text + m_markedPosition, length());
     return FormatToken(tkFormat, anchor(), length());
 }
 
@@ -396,9 +564,60 @@ FormatToken Scanner::readOther()
     return FormatToken(PythonEditor::Unknown, anchor(), length());
 }
 
-void Scanner::clearState()
+Tokenizer::Tokenizer(const QChar *text, const int length, int initialState,
+                     const IdentifierTable *identifiers)
+    : m_scanner(text, length, identifiers)
 {
-    m_state = 0;
+    m_scanner.setState(initialState);
+}
+
+/**
+  reads next token of line, import directives and declarations
+  get their own formats
+  */
+FormatToken Tokenizer::read()
+{
+    const FormatToken tk = m_scanner.read();
+    if (tk.isEndOfBlock())
+        return tk;
+
+    PythonEditor::Format format = tk.format();
+    switch (m_context) {
+        case Import:
+            if (format == PythonEditor::Identifier)
+                format = PythonEditor::ImportedModule;
+            break;
+        case ClassName:
+        case FunctionName:
+            if (format == PythonEditor::Whitespace)
+                break;
+            if (format == PythonEditor::Identifier)
+                format = m_context == ClassName ? PythonEditor::ClassDef : PythonEditor::FunctionDef;
+            m_context = Statement;
+            break;
+        case Statement:
+            if (format == PythonEditor::Keyword && m_hasOnlyWhitespace) {
+                switch (m_scanner.keywordKind(tk)) {
+                    case Scanner::ImportOrFrom:
+                        m_context = Import;
+                        break;
+                    case Scanner::Class:
+                        m_context = ClassName;
+                        break;
+                    case Scanner::Def:
+                        m_context = FunctionName;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            break;
+    }
+
+    if (format != PythonEditor::Whitespace)
+        m_hasOnlyWhitespace = false;
+
+    return FormatToken(format, tk.begin(), tk.length());
 }
 
 } // namespace Internal
@@ -26,6 +26,7 @@
 #pragma once
 
 #include "pythonformattoken.h"
+#include "pythonidentifiertable.h"
 
 #include <QString>
 
@@ -34,6 +35,19 @@ namespace Internal {
 
 /**
  * @brief The Scanner class - scans source code for highlighting only
+ *
+ * Scanner is re-entrant: it keeps all state in the instance and only reads
+ * shared immutable tables, so separate instances may run in parallel threads.
+ * Identifiers are classified with IdentifierTable of the language profile,
+ * Python 3 names are used if no table is given.
+ *
+ * Scanner state is a bit-packed stack of up to MaxStringFrames string frames,
+ * the bottom frame in the lowest FrameBits bits. A frame holds string kind
+ * (State value), prefix flags and, for f-strings, whether scanner is inside a
+ * replacement field and its bracket depth. Nested strings in replacement
+ * fields push frames, so Python 3.12 f-strings like f"{x["key"]:{width}}"
+ * spanning several lines keep their context. State of an ordinary string
+ * equals its State value, Default state is zero.
  */
 class Scanner
 {
@@ -49,7 +63,22 @@ public:
         MultiLineStringDoubleQuote = 4
     };
 
-    Scanner(const QChar *text, const int length);
+    enum StringFrame {
+        KindMask = 0x7,             // State of string
+        RawPrefix = 0x8,
+        BytesPrefix = 0x10,
+        FormatPrefix = 0x20,
+        FormatSpec = 0x40,          // inside format spec of replacement field
+        ExpressionShift = 7,        // bracket depth inside replacement field,
+        ExpressionMask = 0x380,     // 0 if scanner is in literal part
+        MaxExpressionDepth = 7,
+        FrameBits = 10,
+        FrameMask = 0x3ff,
+        MaxStringFrames = 3
+    };
+
+    Scanner(const QChar *text, const int length,
+            const IdentifierTable *identifiers = 0);
 
     void setState(int state);
     int state() const;
@@ -65,7 +94,7 @@ public:
 
     SpecialKeyword keywordKind(const FormatToken &tk) const {
         QString text(m_text + tk.begin(), tk.length());
-        if (text == "import" || text == "from")
+        if (text == "import" || text == "from" || text == "cimport")
             return ImportOrFrom;
         if (text == "class")
             return Class;
@@ -76,10 +105,13 @@ public:
 
 private:
     FormatToken onDefaultState();
+    FormatToken onExpressionState();
 
-    void checkEscapeSequence(QChar quoteChar);
-    FormatToken readStringLiteral(QChar quoteChar);
-    FormatToken readMultiLineStringLiteral(QChar quoteChar);
+    int readStringPrefix();
+    FormatToken readStringStart(QChar quoteChar, int prefix);
+    FormatToken readStringBody();
+    FormatToken readInlineString(QChar quoteChar, bool multiLine);
+    void closeLine();
     FormatToken readIdentifier();
     FormatToken readNumber();
     FormatToken readFloatNumber();
@@ -88,7 +120,11 @@ private:
     FormatToken readWhiteSpace();
     FormatToken readOther();
 
-    void clearState();
+    int frameCount() const;
+    int topFrame() const;
+    void setTopFrame(int frame);
+    void pushFrame(int frame);
+    void popFrame();
 
     void setAnchor() { m_markedPosition = m_position; }
     void move() { ++m_position; }
@@ -106,10 +142,42 @@ private:
 
     const QChar *m_text;
     const int m_textLength;
+    const IdentifierTable *m_identifiers;
     int m_position = 0;
     int m_markedPosition = 0;
 
     int m_state;
+    bool m_continued = false;
+};
+
+/**
+ * @brief The Tokenizer class - reads tokens of single line and refines their
+ * format with the line context: imported modules, class and function names
+ */
+class Tokenizer
+{
+    Tokenizer(const Tokenizer &other) = delete;
+    void operator=(const Tokenizer &other) = delete;
+
+public:
+    Tokenizer(const QChar *text, const int length, int initialState = 0,
+              const IdentifierTable *identifiers = 0);
+
+    FormatToken read();
+    int state() const { return m_scanner.state(); }
+    QString value(const FormatToken &tk) const { return m_scanner.value(tk); }
+
+private:
+    enum Context {
+        Statement,
+        Import,
+        ClassName,
+        FunctionName
+    };
+
+    Scanner m_scanner;
+    Context m_context = Statement;
+    bool m_hasOnlyWhitespace = true;
 };
 
 } // namespace Internal
@@ -0,0 +1,453 @@
+#include "pythonsymbolindex.h"
+#include "pythonscanner.h"
+
+#include <QAtomicInt>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDirIterator>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSet>
+#include <QThreadPool>
+#include <QVector>
+
+#include <algorithm>
+
+namespace PyEditor {
+namespace Internal {
+
+static const quint32 IndexMagic = 0x50594958; // "PYIX"
+static const quint32 IndexVersion = 1;
+
+struct SymbolRecord
+{
+    QString name;
+    QString lowered;
+    qint32 line;
+    qint32 column;
+    qint32 kind;
+};
+
+struct FileEntry
+{
+    QString path;
+    qint64 modified = -1;
+    QByteArray hash;
+    QVector<SymbolRecord> symbols;
+    bool dirty = false;
+};
+
+/**
+ * Lookup key points to the lowered name of symbol, starting from offset:
+ * zero for whole name keys, word start for word keys
+ */
+struct LookupKey
+{
+    int file;
+    int symbol;
+    int offset;
+};
+
+/**
+ * Immutable snapshot of index, replaced as a whole by refresh() and load()
+ */
+class SymbolTable
+{
+public:
+    void rebuildLookup();
+    void collect(const QVector<LookupKey> &keys, const QString &prefix, int limit,
+                 QSet<qint64> &found, QList<PythonSymbol> &result) const;
+
+    QStringRef keyText(const LookupKey &key) const
+    { return files.at(key.file).symbols.at(key.symbol).lowered.midRef(key.offset); }
+
+    QVector<FileEntry> files;
+    QVector<LookupKey> nameKeys;
+    QVector<LookupKey> wordKeys;
+    int symbolCount = 0;
+};
+
+class SymbolIndexData
+{
+public:
+    QStringList rootPaths;
+    SymbolTable table;
+
+    mutable QReadWriteLock lock;    // guards rootPaths and table
+    QMutex refreshMutex;            // serializes refresh() and load()
+};
+
+static SymbolRecord makeSymbol(const QString &name, int line, int column, int kind)
+{
+    const SymbolRecord symbol = { name, name.toLower(), line, column, kind };
+    return symbol;
+}
+
+static int symbolKind(PythonEditor::Format format)
+{
+    switch (format) {
+        case PythonEditor::ClassDef:        return PythonSymbol::Class;
+        case PythonEditor::FunctionDef:     return PythonSymbol::Function;
+        case PythonEditor::ImportedModule:  return PythonSymbol::Import;
+        default:                            return -1;
+    }
+}
+
+/**
+ * Collects declarations of source with the same tokenizer as highlighter uses,
+ * so the index always agrees with class/def/import highlighting
+ */
+static void scanSource(const QString &source, QVector<SymbolRecord> &symbols)
+{
+    const int size = source.size();
+    int state = 0;
+    int line = 0;
+    int lineStart = 0;
+    while (lineStart <= size) {
+        int lineEnd = source.indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd < 0)
+            lineEnd = size;
+
+        Tokenizer tokenizer(source.constData() + lineStart, lineEnd - lineStart, state);
+        FormatToken tk;
+        while (!(tk = tokenizer.read()).isEndOfBlock()) {
+            const int kind = symbolKind(tk.format());
+            if (kind >= 0)
+                symbols.append(makeSymbol(tokenizer.value(tk), line, tk.begin(), kind));
+        }
+
+        state = tokenizer.state();
+        lineStart = lineEnd + 1;
+        ++line;
+    }
+}
+
+/**
+ * Rescans file if its content hash differs from indexed one,
+ * clears dirty flag if content is the same
+ */
+static void scanFile(FileEntry &entry)
+{
+    QFile file(entry.path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        entry.hash.clear();
+        entry.symbols.clear();
+        return;
+    }
+
+    const QByteArray content = file.readAll();
+    const QByteArray hash = QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+    if (hash == entry.hash) {
+        entry.dirty = false;
+        return;
+    }
+
+    entry.hash = hash;
+    entry.symbols.clear();
+    scanSource(QString::fromUtf8(content), entry.symbols);
+}
+
+/**
+ * Worker of refresh(): takes next job from shared counter until jobs are over,
+ * so fast workers pick up the files slow ones didn't reach
+ */
+class ScanTask : public QRunnable
+{
+public:
+    ScanTask(const QVector<FileEntry *> &jobs, QAtomicInt &next)
+        : m_jobs(jobs), m_next(next)
+    {}
+
+    void run() override
+    {
+        for (int i = m_next.fetchAndAddRelaxed(1); i < m_jobs.size(); i = m_next.fetchAndAddRelaxed(1))
+            scanFile(*m_jobs.at(i));
+    }
+
+private:
+    const QVector<FileEntry *> &m_jobs;
+    QAtomicInt &m_next;
+};
+
+static bool isWordStart(const QString &name, int i)
+{
+    const QChar prev = name.at(i - 1);
+    const QChar ch = name.at(i);
+    if (ch == '_')
+        return false;
+    return prev == '_' || (ch.isUpper() && prev.isLower());
+}
+
+void SymbolTable::rebuildLookup()
+{
+    nameKeys.clear();
+    wordKeys.clear();
+    symbolCount = 0;
+
+    for (int f = 0; f < files.size(); ++f) {
+        const QVector<SymbolRecord> &symbols = files.at(f).symbols;
+        symbolCount += symbols.size();
+        for (int s = 0; s < symbols.size(); ++s) {
+            const SymbolRecord &symbol = symbols.at(s);
+            const LookupKey key = { f, s, 0 };
+            nameKeys.append(key);
+
+            // lowering may change length of some unicode names, then words are unknown
+            if (symbol.lowered.size() != symbol.name.size())
+                continue;
+            for (int i = 1; i < symbol.name.size(); ++i) {
+                if (isWordStart(symbol.name, i)) {
+                    const LookupKey wordKey = { f, s, i };
+                    wordKeys.append(wordKey);
+                }
+            }
+        }
+    }
+
+    auto keyLess = [this](const LookupKey &a, const LookupKey &b) {
+        return keyText(a).compare(keyText(b)) < 0;
+    };
+    std::sort(nameKeys.begin(), nameKeys.end(), keyLess);
+    std::sort(wordKeys.begin(), wordKeys.end(), keyLess);
+}
+
+void SymbolTable::collect(const QVector<LookupKey> &keys, const QString &prefix, int limit,
+                          QSet<qint64> &found, QList<PythonSymbol> &result) const
+{
+    QVector<LookupKey>::const_iterator it = std::lower_bound(
+                keys.constBegin(), keys.constEnd(), prefix,
+                [this](const LookupKey &key, const QString &text) {
+        return keyText(key).compare(text) < 0;
+    });
+
+    for (; it != keys.constEnd() && result.size() < limit; ++it) {
+        if (!keyText(*it).startsWith(prefix))
+            break;
+
+        const qint64 id = (qint64(it->file) << 32) | quint32(it->symbol);
+        if (found.contains(id))
+            continue;
+        found.insert(id);
+
+        const FileEntry &entry = files.at(it->file);
+        const SymbolRecord &record = entry.symbols.at(it->symbol);
+        PythonSymbol symbol;
+        symbol.name = record.name;
+        symbol.filePath = entry.path;
+        symbol.line = record.line;
+        symbol.column = record.column;
+        symbol.kind = PythonSymbol::Kind(record.kind);
+        result.append(symbol);
+    }
+}
+
+} // namespace Internal
+} // namespace PythonEditor
+
+using namespace PyEditor::Internal;
+
+PythonSymbolIndex::PythonSymbolIndex()
+    : d(new SymbolIndexData)
+{
+}
+
+PythonSymbolIndex::~PythonSymbolIndex()
+{
+    delete d;
+}
+
+void PythonSymbolIndex::setRootPaths(const QStringList &paths)
+{
+    QWriteLocker locker(&d->lock);
+    d->rootPaths = paths;
+}
+
+QStringList PythonSymbolIndex::rootPaths() const
+{
+    QReadLocker locker(&d->lock);
+    return d->rootPaths;
+}
+
+/**
+ * @brief Synchronizes index with *.py files under root paths
+ * @return Number of files scanned because their content changed
+ *
+ * Files with unchanged modification time are taken from the index as is,
+ * the others are hashed and rescanned only if the hash differs. Scanning runs
+ * on a thread pool; lookups may proceed in other threads meanwhile and
+ * see the new index once refresh is complete.
+ */
+int PythonSymbolIndex::refresh()
+{
+    QMutexLocker locker(&d->refreshMutex);
+    const QStringList rootPaths = this->rootPaths();
+
+    QHash<QString, int> known;
+    const QVector<FileEntry> &current = d->table.files;
+    for (int i = 0; i < current.size(); ++i)
+        known.insert(current.at(i).path, i);
+
+    SymbolTable table;
+    QSet<QString> seen;
+    for (const QString &root : rootPaths) {
+        QDirIterator it(root, QStringList() << QLatin1String("*.py"), QDir::Files,
+                        QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+        while (it.hasNext()) {
+            const QString path = it.next();
+            if (seen.contains(path))
+                continue;
+            seen.insert(path);
+
+            const qint64 modified = it.fileInfo().lastModified().toMSecsSinceEpoch();
+            const int index = known.value(path, -1);
+
+            FileEntry entry;
+            if (index >= 0)
+                entry = current.at(index);
+            entry.path = path;
+            entry.dirty = entry.modified != modified;
+            entry.modified = modified;
+            table.files.append(entry);
+        }
+    }
+
+    QVector<FileEntry *> jobs;
+    for (FileEntry &entry : table.files) {
+        if (entry.dirty)
+            jobs.append(&entry);
+    }
+
+    if (!jobs.isEmpty()) {
+        QAtomicInt next(0);
+        QThreadPool pool;
+        const int workers = qMin(pool.maxThreadCount(), jobs.size());
+        for (int i = 0; i < workers; ++i)
+            pool.start(new ScanTask(jobs, next));
+        pool.waitForDone();
+    }
+
+    int rescanned = 0;
+    for (const FileEntry *entry : jobs) {
+        if (entry->dirty)
+            ++rescanned;
+    }
+
+    table.rebuildLookup();
+
+    QWriteLocker writeLocker(&d->lock);
+    d->table = table;
+    return rescanned;
+}
+
+/**
+ * @brief Replaces index with the one saved by save(), root paths are restored too
+ */
+bool PythonSymbolIndex::load(const QString &indexFile)
+{
+    QFile file(indexFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != IndexMagic || version != IndexVersion)
+        return false;
+
+    QStringList rootPaths;
+    quint32 fileCount = 0;
+    in >> rootPaths >> fileCount;
+
+    SymbolTable table;
+    for (quint32 f = 0; f < fileCount && in.status() == QDataStream::Ok; ++f) {
+        FileEntry entry;
+        quint32 symbolCount = 0;
+        in >> entry.path >> entry.modified >> entry.hash >> symbolCount;
+        for (quint32 s = 0; s < symbolCount && in.status() == QDataStream::Ok; ++s) {
+            QByteArray name;
+            qint32 line = 0;
+            qint32 column = 0;
+            qint8 kind = 0;
+            in >> name >> line >> column >> kind;
+            entry.symbols.append(makeSymbol(QString::fromUtf8(name), line, column, kind));
+        }
+        table.files.append(entry);
+    }
+
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    table.rebuildLookup();
+
+    QMutexLocker locker(&d->refreshMutex);
+    QWriteLocker writeLocker(&d->lock);
+    d->rootPaths = rootPaths;
+    d->table = table;
+    return true;
+}
+
+/**
+ * @brief Writes index to file: names as UTF-8, positions as 32-bit integers
+ */
+bool PythonSymbolIndex::save(const QString &indexFile) const
+{
+    QSaveFile file(indexFile);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    QReadLocker locker(&d->lock);
+    const QVector<FileEntry> &files = d->table.files;
+    out << IndexMagic << IndexVersion << d->rootPaths << quint32(files.size());
+    for (const FileEntry &entry : files) {
+        out << entry.path << entry.modified << entry.hash << quint32(entry.symbols.size());
+        for (const SymbolRecord &symbol : entry.symbols)
+            out << symbol.name.toUtf8() << symbol.line << symbol.column << qint8(symbol.kind);
+    }
+    locker.unlock();
+
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+/**
+ * @brief Returns symbols, whose name or a word of name starts with prefix
+ *
+ * Comparison is case-insensitive, whole name matches go first. Both kinds of
+ * keys are kept sorted, so lookup costs two binary searches plus limit steps.
+ */
+QList<PythonSymbol> PythonSymbolIndex::find(const QString &prefix, int limit) const
+{
+    QList<PythonSymbol> result;
+    if (limit <= 0)
+        return result;
+
+    const QString key = prefix.toLower();
+    QSet<qint64> found;
+
+    QReadLocker locker(&d->lock);
+    d->table.collect(d->table.nameKeys, key, limit, found, result);
+    d->table.collect(d->table.wordKeys, key, limit, found, result);
+    return result;
+}
+
+int PythonSymbolIndex::fileCount() const
+{
+    QReadLocker locker(&d->lock);
+    return d->table.files.size();
+}
+
+int PythonSymbolIndex::symbolCount() const
+{
+    QReadLocker locker(&d->lock);
+    return d->table.symbolCount;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "pythoneditor_global.h"
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+namespace PyEditor {
+    namespace Internal {
+        class SymbolIndexData;
+    }
+}
+
+/**
+ * @brief Class, function or imported name found by PythonSymbolIndex
+ */
+class PYTHONEDITORSHARED_EXPORT PythonSymbol
+{
+public:
+    enum Kind {
+        Class = 0,
+        Function,
+        Import
+    };
+
+    QString name;
+    QString filePath;
+    int line = 0;   // zero-based
+    int column = 0;
+    Kind kind = Class;
+};
+
+/**
+ * @brief The PythonSymbolIndex class - project-wide index of declarations
+ *
+ * Scans all *.py files under root paths with the highlighter's tokenizer on a
+ * thread pool. Refresh is incremental: unchanged files (by modification time,
+ * then by content hash) are not rescanned. The index can be saved to and
+ * loaded from a compact binary file. Lookup is a case-insensitive prefix
+ * match of whole names and of their words (snake_case and CamelCase parts).
+ */
+class PYTHONEDITORSHARED_EXPORT PythonSymbolIndex
+{
+public:
+    PythonSymbolIndex();
+    ~PythonSymbolIndex();
+
+    void setRootPaths(const QStringList &paths);
+    QStringList rootPaths() const;
+
+    int refresh();
+    bool load(const QString &indexFile);
+    bool save(const QString &indexFile) const;
+
+    QList<PythonSymbol> find(const QString &prefix, int limit = 50) const;
+
+    int fileCount() const;
+    int symbolCount() const;
+
+private:
+    Q_DISABLE_COPY(PythonSymbolIndex)
+
+    PyEditor::Internal::SymbolIndexData *d;
+};
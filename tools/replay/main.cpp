@@ -0,0 +1,134 @@
+#include "pythoneditor.h"
+
+#include <QApplication>
+#include <QClipboard>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QInputMethodEvent>
+#include <QKeyEvent>
+#include <QTextStream>
+#include <QThread>
+#include <QUrl>
+
+/**
+ * Replays editing session, recorded by PythonEditor::recordedSession(),
+ * against Python source in a headless editor and reports input latency.
+ * Exits with 1 if latency regresses past given thresholds.
+ */
+
+static QString decodeText(const QString &text)
+{ return QUrl::fromPercentEncoding(text.toLatin1()); }
+
+static void setCursorPosition(PythonEditor &editor, int position, int anchor)
+{
+    const int last = editor.document()->characterCount() - 1;
+    QTextCursor cursor = editor.textCursor();
+    cursor.setPosition(qBound(0, anchor, last));
+    cursor.setPosition(qBound(0, position, last), QTextCursor::KeepAnchor);
+    editor.setTextCursor(cursor);
+}
+
+static void send(PythonEditor &editor, QEvent *event)
+{
+    QApplication::sendEvent(&editor, event);
+    QApplication::processEvents();
+    editor.viewport()->repaint();
+}
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays recorded editing session against Python source and reports input latency.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("source", "Python source to edit.");
+    parser.addPositionalArgument("session", "Session recorded by PythonEditor::recordedSession().");
+    QCommandLineOption maxP50Option("max-p50", "Fail if median latency exceeds <ms>.", "ms");
+    QCommandLineOption maxP99Option("max-p99", "Fail if 99th percentile latency exceeds <ms>.", "ms");
+    QCommandLineOption realtimeOption("realtime", "Keep recorded delays between events.");
+    parser.addOption(maxP50Option);
+    parser.addOption(maxP99Option);
+    parser.addOption(realtimeOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2)
+        parser.showHelp(2);
+
+    QFile sourceFile(args.at(0));
+    if (!sourceFile.open(QIODevice::ReadOnly)) {
+        qCritical("Can't open source %s", qPrintable(args.at(0)));
+        return 2;
+    }
+    QFile sessionFile(args.at(1));
+    if (!sessionFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCritical("Can't open session %s", qPrintable(args.at(1)));
+        return 2;
+    }
+
+    PythonEditor editor;
+    editor.resize(1024, 768);
+    editor.setPlainText(QString::fromUtf8(sourceFile.readAll()));
+    editor.show();
+    QApplication::processEvents();
+
+    editor.setLatencyRecording(true);
+
+    const bool realtime = parser.isSet(realtimeOption);
+    QTextStream session(&sessionFile);
+    while (!session.atEnd()) {
+        const QStringList fields = session.readLine().split(QLatin1Char('\t'));
+        if (fields.size() < 3)
+            continue;
+
+        if (realtime)
+            QThread::msleep(fields.at(1).toULong());
+
+        const QString kind = fields.at(0);
+        if (kind == QLatin1String("cursor")) {
+            const int position = fields.at(2).toInt();
+            setCursorPosition(editor, position, fields.size() >= 4 ? fields.at(3).toInt() : position);
+        } else if (kind == QLatin1String("clipboard")) {
+            QApplication::clipboard()->setText(decodeText(fields.at(2)));
+        } else if (kind == QLatin1String("key") && fields.size() >= 5) {
+            const int key = fields.at(2).toInt();
+            const Qt::KeyboardModifiers modifiers(fields.at(3).toInt());
+            const QString text = decodeText(fields.at(4));
+            QKeyEvent press(QEvent::KeyPress, key, modifiers, text);
+            send(editor, &press);
+            QKeyEvent release(QEvent::KeyRelease, key, modifiers, text);
+            QApplication::sendEvent(&editor, &release);
+        } else if (kind == QLatin1String("text")) {
+            QInputMethodEvent event;
+            event.setCommitString(decodeText(fields.at(2)));
+            send(editor, &event);
+        }
+    }
+
+    const PythonLatencyReport report = editor.latencyReport();
+    QTextStream out(stdout);
+    out << "samples: " << report.samples << "\n"
+        << "p50: " << report.p50 / 1000.0 << " ms\n"
+        << "p99: " << report.p99 / 1000.0 << " ms\n"
+        << "max: " << report.max / 1000.0 << " ms\n"
+        << "average edit: " << report.editAverage / 1000.0 << " ms"
+        << " (highlight " << report.highlightAverage / 1000.0 << " ms)\n"
+        << "average paint: " << report.paintAverage / 1000.0 << " ms\n";
+    out.flush();
+
+    bool failed = false;
+    if (parser.isSet(maxP50Option) && report.p50 / 1000.0 > parser.value(maxP50Option).toDouble()) {
+        qCritical("p50 latency exceeds %s ms", qPrintable(parser.value(maxP50Option)));
+        failed = true;
+    }
+    if (parser.isSet(maxP99Option) && report.p99 / 1000.0 > parser.value(maxP99Option).toDouble()) {
+        qCritical("p99 latency exceeds %s ms", qPrintable(parser.value(maxP99Option)));
+        failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
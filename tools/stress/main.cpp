@@ -0,0 +1,123 @@
+#include "pythoneditor.h"
+
+#include <QAtomicInt>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRunnable>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include <cstring>
+
+/**
+ * Runs PythonEditor::tokenize() over Python sources from several threads at
+ * once, checks every token stream against a single-threaded reference and
+ * reports throughput per thread count. Exits with 1 on a mismatch.
+ */
+
+static bool sameTokens(const QVector<PythonToken> &a, const QVector<PythonToken> &b)
+{
+    return a.size() == b.size()
+            && memcmp(a.constData(), b.constData(), a.size() * sizeof(PythonToken)) == 0;
+}
+
+class TokenizeJob : public QRunnable
+{
+public:
+    TokenizeJob(const QStringList &sources, const QVector<QVector<PythonToken>> &reference,
+                int rounds, QAtomicInt &mismatches)
+        : m_sources(sources), m_reference(reference), m_rounds(rounds), m_mismatches(mismatches)
+    {}
+
+    void run() override
+    {
+        for (int round = 0; round < m_rounds; ++round) {
+            for (int i = 0; i < m_sources.size(); ++i) {
+                if (!sameTokens(PythonEditor::tokenize(m_sources.at(i)), m_reference.at(i)))
+                    m_mismatches.fetchAndAddRelaxed(1);
+            }
+        }
+    }
+
+private:
+    const QStringList &m_sources;
+    const QVector<QVector<PythonToken>> &m_reference;
+    const int m_rounds;
+    QAtomicInt &m_mismatches;
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Tokenizes Python sources from several threads and reports throughput.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("sources", "Python sources to tokenize.", "<source>...");
+    QCommandLineOption threadsOption("threads", "Scale up to <n> threads.", "n",
+                                     QString::number(QThread::idealThreadCount()));
+    QCommandLineOption roundsOption("rounds", "Tokenize every source <n> times per thread.", "n", "10");
+    parser.addOption(threadsOption);
+    parser.addOption(roundsOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.isEmpty())
+        parser.showHelp(2);
+
+    QStringList sources;
+    qint64 characters = 0;
+    for (const QString &path : args) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical("Can't open source %s", qPrintable(path));
+            return 2;
+        }
+        sources.append(QString::fromUtf8(file.readAll()));
+        characters += sources.last().size();
+    }
+
+    QVector<QVector<PythonToken>> reference;
+    for (const QString &source : sources)
+        reference.append(PythonEditor::tokenize(source));
+
+    const int maxThreads = qMax(1, parser.value(threadsOption).toInt());
+    const int rounds = qMax(1, parser.value(roundsOption).toInt());
+
+    QVector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.append(threads);
+    threadCounts.append(maxThreads);
+
+    QTextStream out(stdout);
+    QAtomicInt mismatches;
+    double singleThreadRate = 0;
+    for (int threads : threadCounts) {
+        QThreadPool pool;
+        pool.setMaxThreadCount(threads);
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < threads; ++i)
+            pool.start(new TokenizeJob(sources, reference, rounds, mismatches));
+        pool.waitForDone();
+        const qint64 elapsed = qMax<qint64>(1, timer.nsecsElapsed() / 1000);
+
+        const double rate = double(characters) * rounds * threads / elapsed;   // characters per microsecond
+        if (threads == 1)
+            singleThreadRate = rate;
+        out << threads << " threads: " << rate << " M chars/s, speedup "
+            << rate / singleThreadRate << "x\n";
+        out.flush();
+    }
+
+    if (mismatches.load() != 0) {
+        qCritical("%d token streams differ from single-threaded result", mismatches.load());
+        return 1;
+    }
+
+    return 0;
+}
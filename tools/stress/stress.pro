@@ -0,0 +1,13 @@
+QT       += widgets
+TARGET = pythoneditor-stress
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../src
+LIBS += -L../../src -lpythoneditor
+win32: LIBS += -L../../src/release
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,80 @@
+"""Tokenizes Python sources with PythonEditor.tokenize() from 1..N Python
+threads and prints throughput and speedup. The bindings release the GIL
+while scanning, so speedup should grow with threads. Token streams are
+checked against a single-threaded run, exits with 1 on a mismatch."""
+
+import argparse
+import os
+import sys
+import threading
+import time
+
+from PyQt5.QtCore import QCoreApplication
+from PyPythonEditor import PythonEditor
+
+
+def token_bytes(source):
+    return bytes(memoryview(PythonEditor.tokenize(source)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("sources", nargs="+", help="Python sources to tokenize")
+    parser.add_argument("--threads", type=int, default=os.cpu_count() or 1,
+                        help="scale up to N threads")
+    parser.add_argument("--rounds", type=int, default=10,
+                        help="tokenize every source N times per thread")
+    args = parser.parse_args()
+
+    app = QCoreApplication(sys.argv)
+
+    sources = []
+    for path in args.sources:
+        with open(path, encoding="utf-8", errors="replace") as f:
+            sources.append(f.read())
+    characters = sum(len(source) for source in sources)
+    reference = [token_bytes(source) for source in sources]
+
+    max_threads = max(1, args.threads)
+    rounds = max(1, args.rounds)
+    thread_counts = []
+    threads = 1
+    while threads < max_threads:
+        thread_counts.append(threads)
+        threads *= 2
+    thread_counts.append(max_threads)
+
+    mismatches = []
+
+    def work():
+        for _ in range(rounds):
+            for source, expected in zip(sources, reference):
+                if token_bytes(source) != expected:
+                    mismatches.append(1)
+
+    single_thread_rate = None
+    for count in thread_counts:
+        workers = [threading.Thread(target=work) for _ in range(count)]
+        start = time.perf_counter()
+        for worker in workers:
+            worker.start()
+        for worker in workers:
+            worker.join()
+        elapsed = time.perf_counter() - start
+
+        rate = characters * rounds * count / elapsed / 1e6
+        if single_thread_rate is None:
+            single_thread_rate = rate
+        print("%d threads: %.1f M chars/s, speedup %.2fx"
+              % (count, rate, rate / single_thread_rate))
+        sys.stdout.flush()
+
+    if mismatches:
+        print("%d token streams differ from single-threaded result" % len(mismatches),
+              file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())